@@ -0,0 +1,250 @@
+// headless benchmarks: render representative graphs on an offline server and
+// print the timings as JSON on stdout, so they can be compared across
+// versions.
+//
+// usage: bench [seconds of audio rendered per case] [worker threads]
+
+#include "core.hpp"
+#include "simd.hpp"
+#include "osc.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+static const Samplerate srate = 44100;
+static const int channels = 2;
+
+static Duration frames; // rendered per case
+static vector<UGenPtr> keep; // ugens of the current case
+static bool first = true;
+
+///////////////////////////////////////////////////////////////////////////////
+// class Thru
+
+// copies its input to its output, the cheapest node doing something
+struct Thru : UGen
+{
+    Thru(int size) : UGen(size, size)
+    {}
+
+    void process(int offset, int frames)
+    {
+        for (int c=0; c<inputSize; c++) {
+            memcpy(&output[c*blockSize + offset], &input[c*blockSize + offset],
+                    frames * sizeof(Sample));
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// python shreds
+
+// a shred waking up every period samples. a class rather than a generator
+// so that it does not depend on the python version.
+static const char *wakerSource =
+    "class Waker(object):\n"
+    "    def __init__(self, period):\n"
+    "        self.period = period\n"
+    "        self.count = 0\n"
+    "    def next(self):\n"
+    "        self.count += 1\n"
+    "        return self.period\n"
+    "    __next__ = next\n"
+    "    def send(self, value):\n"
+    "        return self.next()\n"
+    "    def close(self):\n"
+    "        pass\n";
+
+///////////////////////////////////////////////////////////////////////////////
+// measurements
+
+static double seconds()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// remove the current graph and shreds from the server
+static void reset()
+{
+    ServerPtr s = Server::singleton;
+    for (size_t i=0; i<keep.size(); i++) {
+        s->io->removeSource(keep[i]);
+    }
+    keep.clear();
+    s->queue.clear();
+    Server::invalidate();
+}
+
+static UGenPtr add(UGen *ugen)
+{
+    UGenPtr u(ugen);
+    keep.push_back(u);
+    return u;
+}
+
+// render the current graph and print its timings. voices is the number of
+// identical voices in the graph, if that makes sense.
+static void measure(string name, int size, int voices)
+{
+    ServerPtr s = Server::singleton;
+    vector<Sample> buffer(s->bufferFrames * channels);
+
+    // one block to warm up caches and let the schedule settle
+    s->render(&buffer[0], s->bufferFrames);
+
+    Duration done = 0;
+    double start = seconds();
+    while (done < frames) {
+        s->render(&buffer[0], s->bufferFrames);
+        done += s->bufferFrames;
+    }
+    double elapsed = seconds() - start;
+
+    // time spent per sample frame, against the time available in realtime
+    double ns = elapsed * 1e9 / done;
+    double budget = 1e9 / srate;
+
+    printf("%s\n    {\"name\": \"%s\", \"size\": %d, \"ns_per_sample\": %.3f, \"realtime\": %.2f",
+            first ? "" : ",", name.c_str(), size, ns, budget / ns);
+    if (voices) {
+        printf(", \"ns_per_voice\": %.3f, \"max_voices\": %.0f",
+                ns / voices, budget * voices / ns);
+    }
+    printf("}");
+    first = false;
+    fflush(stdout);
+
+    reset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cases
+
+// independent oscillators straight into io
+template <typename T>
+static void oscillators(string name, int count)
+{
+    ServerPtr s = Server::singleton;
+    for (int i=0; i<count; i++) {
+        UGenPtr osc = add(new T());
+        s->io->addSource(osc);
+    }
+    measure(name, count, count);
+}
+
+// osc -> thru -> ... -> io
+static void chain(int depth)
+{
+    UGenPtr last = add(new Sin());
+    for (int i=0; i<depth; i++) {
+        UGenPtr thru = add(new Thru(1));
+        thru->addSource(last);
+        last = thru;
+    }
+    Server::singleton->io->addSource(last);
+    measure("chain", depth, 0);
+}
+
+// many oscillators into one node through scaled routes
+static void fanin(int width)
+{
+    UGenPtr thru = add(new Thru(1));
+    for (int i=0; i<width; i++) {
+        UGenPtr osc = add(new Sin());
+        RoutePtr route(new Route(1, 1));
+        route->setGain(0, 0, 0.5);
+        thru->addSourceRoute(osc, route);
+    }
+    Server::singleton->io->addSource(thru);
+    measure("fanin", width, width);
+}
+
+// 8 channels nodes, fed by broadcast and mixed down to io by dense routes
+static void multichannel(int count)
+{
+    ServerPtr s = Server::singleton;
+    for (int i=0; i<count; i++) {
+        UGenPtr osc = add(new Sin());
+        UGenPtr thru = add(new Thru(8));
+        thru->addSourceRoute(osc, RoutePtr(new Route(1, 8)));
+
+        RoutePtr down(new Route(8, channels));
+        for (int j=0; j<8; j++) {
+            down->setGain(j, j % channels, 0.25);
+            down->setGain(j, (j+1) % channels, 0.125);
+        }
+        s->io->addSourceRoute(thru, down);
+    }
+    measure("multichannel", count, count);
+}
+
+// python shreds waking up every period samples, over a single oscillator
+static void shreds(int count, Duration period)
+{
+    ServerPtr s = Server::singleton;
+    s->io->addSource(add(new Sin()));
+
+    object waker = import("__main__").attr("Waker");
+    for (int i=0; i<count; i++) {
+        s->spork(waker(period));
+    }
+
+    char name[32];
+    sprintf(name, "shreds/%lu", period);
+    measure(name, count, 0);
+}
+
+int main(int argc, char **argv)
+{
+    double duration = argc > 1 ? atof(argv[1]) : 10;
+    int workers = argc > 2 ? atoi(argv[2]) : 0;
+
+    Py_Initialize();
+    PyRun_SimpleString(wakerSource);
+
+    Server::openOffline(channels, srate, Server::defaultBufferFrames);
+    Server::singleton->setWorkers(workers);
+    frames = (Duration) (duration * srate);
+
+    printf("{\"srate\": %lu, \"bufferFrames\": %u, \"channels\": %d, \"simd\": \"%s\", \"seconds\": %g, \"workers\": %d,\n",
+            srate, Server::singleton->bufferFrames, channels, simdName(), duration, workers);
+    printf("  \"results\": [");
+
+    int sizes[] = {1, 16, 64, 256};
+    for (int i=0; i<4; i++) {
+        oscillators<Sin>("sin", sizes[i]);
+    }
+    for (int i=0; i<4; i++) {
+        oscillators<Saw>("saw", sizes[i]);
+    }
+    for (int i=0; i<4; i++) {
+        chain(sizes[i]);
+    }
+    for (int i=1; i<4; i++) {
+        fanin(sizes[i]);
+    }
+    for (int i=0; i<3; i++) {
+        multichannel(sizes[i]);
+    }
+    Duration periods[] = {32, 256, 4096};
+    for (int i=0; i<3; i++) {
+        for (int j=0; j<3; j++) {
+            shreds(sizes[i], periods[j]);
+        }
+    }
+
+    printf("\n  ]\n}\n");
+
+    Server::singleton.reset();
+    return 0;
+}
@@ -0,0 +1,60 @@
+// checks of the python side of parameters: they compare by value, and ramps
+// to values their setter would refuse raise. exits with 1 on the first failure.
+
+#include "core.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+#if PY_MAJOR_VERSION >= 3
+extern "C" PyObject *PyInit_libcore();
+extern "C" PyObject *PyInit_libosc();
+#define INIT(name) PyInit_##name
+#else
+extern "C" void initlibcore();
+extern "C" void initlibosc();
+#define INIT(name) init##name
+#endif
+
+static const char *checks =
+    "import libcore, libosc\n"
+    "osc = libosc.Sin()\n"
+    "assert osc.freq == 440, 'freq == 440'\n"
+    "assert not (osc.freq != 440), 'freq != 440'\n"
+    "assert 440 == osc.freq, '440 == freq'\n"
+    "assert osc.freq < 441 and osc.freq <= 440, 'freq < 441'\n"
+    "assert osc.freq > 439 and osc.freq >= 440, 'freq > 439'\n"
+    "assert osc.freq != None, 'freq != None'\n"
+    "assert repr(osc.freq) == '440.0', repr(osc.freq)\n"
+    "def refused(f):\n"
+    "    try:\n"
+    "        f()\n"
+    "    except ValueError:\n"
+    "        return True\n"
+    "    return False\n"
+    "assert refused(lambda: osc.freq.rampTo(-100, 10)), 'negative freq ramp'\n"
+    "assert refused(lambda: osc.freq.smooth(0, 10)), 'zero freq smooth'\n"
+    "assert refused(lambda: osc.gain.rampTo(-1, 10)), 'negative gain ramp'\n"
+    "assert refused(lambda: osc.gain.expTo(0, 10)), 'exponential ramp to 0'\n"
+    "osc.gain.rampTo(0, 10)\n"
+    "osc.freq.expTo(880, 10)\n"
+    "print('params: ok')\n";
+
+int main(int argc, char **argv)
+{
+    PyImport_AppendInittab((char *) "libcore", INIT(libcore));
+    PyImport_AppendInittab((char *) "libosc", INIT(libosc));
+    Py_Initialize();
+    Server::openOffline(1, 44100, Server::defaultBufferFrames);
+
+    int failed = PyRun_SimpleString(checks);
+
+    fflush(stdout);
+    // the offline server has no threads to stop, but it would be closed
+    // by the static destructors, once python is gone
+    _exit(failed ? 1 : 0);
+}
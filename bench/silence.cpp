@@ -0,0 +1,66 @@
+// checks that silence spreads down the graph: once a source goes quiet, the
+// nodes it feeds fall asleep too, and wake up with it. exits with 1 on the
+// first failure.
+
+#include "core.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+#if PY_MAJOR_VERSION >= 3
+extern "C" PyObject *PyInit_libcore();
+extern "C" PyObject *PyInit_libosc();
+extern "C" PyObject *PyInit_libdelay();
+#define INIT(name) PyInit_##name
+#else
+extern "C" void initlibcore();
+extern "C" void initlibosc();
+extern "C" void initlibdelay();
+#define INIT(name) init##name
+#endif
+
+static const char *checks =
+    "import libcore, libosc, libdelay\n"
+    "server = libcore.Server.openOffline(1, 44100, 256)\n"
+    "osc = libosc.Sin()\n"
+    "osc.gain = 0.5\n"
+    "thru = libcore.UGen(1, 1)\n"
+    "thru.addSource(osc)\n"
+    "delay = libdelay.Delay(1, 512)\n"
+    "delay.addSource(osc)\n"
+    "server.dac.addSource(thru)\n"
+    "server.dac.addSource(delay)\n"
+    "server.render(1024)\n"
+    "assert not osc.silent and not delay.silent, 'awake while playing'\n"
+    "osc.gain = 0\n"
+    "server.render(256)\n"
+    "assert osc.silent, 'source asleep'\n"
+    "assert not delay.silent, 'delay awake while its ring plays'\n"
+    "server.render(1024)\n"
+    "assert delay.silent, 'delay asleep once its ring is silent'\n"
+    "assert not thru.silent, 'a plain ugen never sleeps'\n"
+    "osc.gain = 0.5\n"
+    "server.render(256)\n"
+    "assert not osc.silent, 'awake again'\n"
+    "server.render(256)\n"
+    "assert not delay.silent, 'delay awake once its input is stored'\n"
+    "print('silence: ok')\n";
+
+int main(int argc, char **argv)
+{
+    PyImport_AppendInittab((char *) "libcore", INIT(libcore));
+    PyImport_AppendInittab((char *) "libosc", INIT(libosc));
+    PyImport_AppendInittab((char *) "libdelay", INIT(libdelay));
+    Py_Initialize();
+
+    int failed = PyRun_SimpleString(checks);
+
+    fflush(stdout);
+    // the offline server has no threads to stop, but it would be closed
+    // by the static destructors, once python is gone
+    _exit(failed ? 1 : 0);
+}
@@ -0,0 +1,136 @@
+// checks of the shred timing wheel: shreds come out in time order, never
+// before their time. exits with 1 on the first failure.
+
+#include "core.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+static vector<ShredPtr> keep;
+static int failures = 0;
+
+static void push(ShredWheel& wheel, Time time)
+{
+    ShredPtr shred(new Shred(object(), 0));
+    shred->next = time;
+    keep.push_back(shred);
+    wheel.push(shred);
+}
+
+// pop the shreds due up to the given time, in order
+static void pop(ShredWheel& wheel, Time until, vector<ShredPtr>& due)
+{
+    while (wheel.wake <= until) {
+        ShredPtr shred = wheel.pop(until);
+        while (shred) {
+            due.push_back(shred);
+            ShredPtr following = shred->following;
+            shred->following.reset();
+            shred = following;
+        }
+    }
+}
+
+// pop until the given time, and compare the times of the shreds due
+static void expect(ShredWheel& wheel, Time until, vector<Time> times, const char *what)
+{
+    vector<ShredPtr> due;
+    pop(wheel, until, due);
+    vector<Time> got;
+    for (size_t i=0; i<due.size(); i++) {
+        got.push_back(due[i]->next);
+    }
+    if (got != times) {
+        printf("FAIL %s: %d shreds due, %d expected\n", what, (int) got.size(), (int) times.size());
+        failures++;
+    }
+}
+
+// a far shred leaves the current time at until: shreds pushed on the way
+// still find their slot, and only those behind it go to the late list
+static void late()
+{
+    ShredWheel wheel;
+    push(wheel, 10000);
+    push(wheel, 1000);
+    push(wheel, 1000);
+    expect(wheel, 1000, vector<Time>(2, 1000), "before the far one");
+
+    push(wheel, 1100);
+    push(wheel, 4000);
+    if (!wheel.late.empty()) {
+        printf("FAIL late: shreds pushed after until went to the late list\n");
+        failures++;
+    }
+    expect(wheel, 1100, vector<Time>(1, 1100), "up to 1100");
+    expect(wheel, 3999, vector<Time>(), "up to 3999");
+
+    push(wheel, 3000);
+    push(wheel, 3999);
+    vector<Time> times;
+    times.push_back(3000);
+    times.push_back(3999);
+    times.push_back(4000);
+    expect(wheel, 4000, times, "late, up to 4000");
+    expect(wheel, 10000, vector<Time>(1, 10000), "the far one");
+}
+
+// random times over every level, popped in small steps
+static void spread()
+{
+    srand(7);
+    for (int round=0; round<100; round++) {
+        ShredWheel wheel;
+        Time now = rand() % 100000;
+        vector<Time> times;
+        for (int i=0; i<200; i++) {
+            Time time = now + ((Time) rand() << (rand() % 24)) % (1UL << 34);
+            push(wheel, time);
+            times.push_back(time);
+        }
+
+        Time until = now;
+        Time last = 0;
+        while (!wheel.empty()) {
+            until += rand() % 5000;
+            vector<ShredPtr> due;
+            pop(wheel, until, due);
+            for (size_t i=0; i<due.size(); i++) {
+                if (until < due[i]->next || due[i]->next < last) {
+                    printf("FAIL spread: shred at %lu due at %lu\n", due[i]->next, until);
+                    failures++;
+                    return;
+                }
+                last = due[i]->next;
+            }
+            // push some behind the current time of the wheel
+            if (rand() % 8 == 0) {
+                push(wheel, until + 1 + rand() % 1000);
+            }
+            // and skip empty stretches
+            if (wheel.wake != ShredWheel::never && until < wheel.wake && rand() % 2) {
+                until = wheel.wake - 1;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Py_Initialize();
+    Server::openOffline(1, 44100, Server::defaultBufferFrames);
+
+    late();
+    spread();
+
+    printf(failures ? "wheel: %d failures\n" : "wheel: ok\n", failures);
+    fflush(stdout);
+    // the offline server has no threads to stop, but it would be closed
+    // by the static destructors, once python is gone
+    _exit(failures ? 1 : 0);
+}
@@ -1,111 +1,374 @@
 #include "core.hpp"
+#include "simd.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <ctime>
+#include <typeinfo>
+#include <cxxabi.h>
+#include <pthread.h>
 
 using namespace boost;
 using namespace boost::python;
 using namespace std;
 
+// Arena class
+///////////////////////////////////////////////////////////////////////////////
+
+Arena::Arena()
+{
+    cursor = NULL;
+    left = 0;
+    for (int i=0; i<classes; i++) {
+        freeList[i] = NULL;
+    }
+}
+
+Arena& Arena::instance()
+{
+    // never destroyed: static objects such as the server still hand blocks
+    // back at exit
+    static Arena *arena = new Arena();
+    return *arena;
+}
+
+int Arena::sizeClass(size_t bytes)
+{
+    // the smallest power of two holding bytes, at least the alignment
+    int c = 0;
+    while (c < classes && ((size_t) alignment << c) < bytes) {
+        c++;
+    }
+    if (c == classes) {
+        throw std::bad_alloc();
+    }
+    return c;
+}
+
+size_t Arena::product(int n, int m)
+{
+    // sizes of blocks, checked before they wrap around
+    if (n < 0 || m < 0 || (m && (size_t) n > (size_t) -1 / sizeof(Sample) / m)) {
+        throw std::bad_alloc();
+    }
+    return (size_t) n * m;
+}
+
+void *Arena::allocate(size_t bytes)
+{
+    int c = sizeClass(bytes);
+    boost::lock_guard<boost::mutex> lock(mutex);
+
+    if (freeList[c]) {
+        void *block = freeList[c];
+        freeList[c] = *(void **) block;
+        return block;
+    }
+
+    // carve a new block, from a new slab if this one is too small. big
+    // blocks get a slab of their own.
+    size_t size = (size_t) alignment << c;
+    if (left < size) {
+        size_t slab = std::max(size, (size_t) slabSize);
+        char *memory = new char[slab + alignment];
+        slabs.push_back(memory);
+        cursor = memory + alignment - ((size_t) memory % alignment);
+        left = slab;
+    }
+    void *block = cursor;
+    cursor += size;
+    left -= size;
+    return block;
+}
+
+void Arena::release(void *block, size_t bytes)
+{
+    if (!block) {
+        return;
+    }
+    boost::lock_guard<boost::mutex> lock(mutex);
+    int c = sizeClass(bytes);
+    *(void **) block = freeList[c];
+    freeList[c] = block;
+}
+
+shared_array<Sample> Arena::samples(size_t count)
+{
+    if (count > (size_t) -1 / sizeof(Sample)) {
+        throw std::bad_alloc();
+    }
+    size_t bytes = std::max(count, (size_t) 1) * sizeof(Sample);
+    Sample *block = (Sample *) instance().allocate(bytes);
+    return shared_array<Sample>(block, ArenaDeleter(bytes));
+}
+
 // UGen class
 ///////////////////////////////////////////////////////////////////////////////
 
+// channel counts given from python
+static void checkChannels(int inputs, int outputs)
+{
+    if (inputs < 0 || outputs < 0) {
+        PyErr_SetString(PyExc_ValueError, "channel counts cannot be negative");
+        throw_error_already_set();
+    }
+}
+
 UGen::UGen()
 {
     this->inputSize = 1;
     this->outputSize = 1;
+    this->pinned = false;
+    this->feedback = false;
+    this->silent = false;
+    this->queued = NULL;
+    this->lastQueued = NULL;
+    this->gate = NULL;
+    this->gateIndex = 0;
 
     // special case if the server is not yet started
     if (Server::singleton) {
-        this->last = Server::singleton->now;
+        allocate(Server::singleton->bufferFrames);
     } else {
-        this->last = 0;
+        allocate(Server::defaultBufferFrames);
     }
-
-    this->input = shared_array<Sample>(new Sample[inputSize]);
-    resetInput();
-
-    this->output = shared_array<Sample>(new Sample[outputSize]);
-    resetOutput();
 }
 
 UGen::UGen(int inputs, int outputs)
 {
+    checkChannels(inputs, outputs);
     this->inputSize = inputs;
     this->outputSize = outputs;
+    this->pinned = false;
+    this->feedback = false;
+    this->silent = false;
+    this->queued = NULL;
+    this->lastQueued = NULL;
+    this->gate = NULL;
+    this->gateIndex = 0;
 
     // special case if the server is not yet started
     if (Server::singleton) {
-        this->last = Server::singleton->now;
+        allocate(Server::singleton->bufferFrames);
     } else {
-        this->last = 0;
+        allocate(Server::defaultBufferFrames);
     }
-
-    this->input = shared_array<Sample>(new Sample[inputSize]);
-    resetInput();
-
-    this->output = shared_array<Sample>(new Sample[outputSize]);
-    resetOutput();
 }
 
 UGen::UGen(UGenPtr source)
 {
     inputSize = source->outputSize;
     outputSize = inputSize;
+    pinned = false;
+    feedback = false;
+    silent = false;
+    queued = NULL;
+    lastQueued = NULL;
+    gate = NULL;
+    gateIndex = 0;
 
     // special case if the server is not yet started
     if (Server::singleton) {
-        this->last = Server::singleton->now;
+        allocate(Server::singleton->bufferFrames);
     } else {
-        this->last = 0;
+        allocate(Server::defaultBufferFrames);
     }
 
-    this->input = shared_array<Sample>(new Sample[inputSize]);
-    resetInput();
-
-    this->output = shared_array<Sample>(new Sample[outputSize]);
-    resetOutput();
-
     addSource(source);
 }
 
 UGen::~UGen()
 {}
 
-Time UGen::getLast()
+void UGen::allocate(int blockSize)
 {
-    return this->last;
+    this->blockSize = blockSize;
+    this->position = 0;
+
+    this->input = Arena::samples(Arena::product(inputSize, blockSize));
+    resetInput(0, blockSize);
+
+    this->output = Arena::samples(Arena::product(outputSize, blockSize));
+    resetOutput(0, blockSize);
 }
 
 Sample UGen::getInput(int channel)
 {
-    return this->input[channel];
+    // most recent sample of the channel
+    return this->input[channel*blockSize + max(position-1, 0)];
 }
 
 void UGen::setInput(int channel, Sample value)
 {
-    this->input[channel] = value;
+    for (int i=0; i<blockSize; i++) {
+        this->input[channel*blockSize + i] = value;
+    }
 }
 
-void UGen::resetInput()
+void UGen::resetInput(int offset, int frames)
 {
-    for (int i=0; i<inputSize; i++) {
-        input[i] = 0.0f;
+    // a whole block is contiguous across channels
+    if (frames == blockSize) {
+        fill_n(&input[0], inputSize*blockSize, (Sample) 0);
+        return;
+    }
+    for (int c=0; c<inputSize; c++) {
+        Sample *in = &input[c*blockSize + offset];
+        for (int i=0; i<frames; i++) {
+            in[i] = 0.0f;
+        }
     }
 }
 
 Sample UGen::getOutput(int channel)
 {
-    return this->output[channel];
+    // most recent sample of the channel
+    return this->output[channel*blockSize + max(position-1, 0)];
 }
 
 void UGen::setOutput(int channel, Sample value)
 {
-    this->output[channel] = value;
+    for (int i=0; i<blockSize; i++) {
+        this->output[channel*blockSize + i] = value;
+    }
+}
+
+void UGen::resetOutput(int offset, int frames)
+{
+    if (frames == blockSize) {
+        fill_n(&output[0], outputSize*blockSize, (Sample) 0);
+        return;
+    }
+    for (int c=0; c<outputSize; c++) {
+        Sample *out = &output[c*blockSize + offset];
+        for (int i=0; i<frames; i++) {
+            out[i] = 0.0f;
+        }
+    }
+}
+
+// a python object exporting frames of a block through the buffer protocol.
+// it holds a reference to the samples, so a view stays valid even if the
+// ugen allocates new blocks. the device buffers bound to io cannot be held
+// that way, and are not viewed.
+struct BlockView
+{
+    PyObject_HEAD
+    boost::shared_array<Sample> *samples;
+    Sample *data;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+};
+
+static int getBlockBuffer(PyObject *self, Py_buffer *view, int flags)
+{
+    BlockView *block = (BlockView*) self;
+    bool contiguous = block->shape[0] <= 1 || 
+        block->strides[0] == block->shape[1] * (Py_ssize_t) sizeof(Sample);
+    if ((flags & PyBUF_STRIDES) != PyBUF_STRIDES && !contiguous) {
+        PyErr_SetString(PyExc_BufferError, "block view is not contiguous");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->buf = block->data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = block->shape[0] * block->shape[1] * sizeof(Sample);
+    view->readonly = 0;
+    view->itemsize = sizeof(Sample);
+    view->format = NULL;
+    if (flags & PyBUF_FORMAT) {
+        view->format = (char*) (sizeof(Sample) == sizeof(float) ? "f" : "d");
+    }
+    view->ndim = 1;
+    view->shape = NULL;
+    if ((flags & PyBUF_ND) == PyBUF_ND) {
+        view->ndim = 2;
+        view->shape = block->shape;
+    }
+    view->strides = NULL;
+    if ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) {
+        view->strides = block->strides;
+    }
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void deleteBlockView(PyObject *self)
+{
+    delete ((BlockView*) self)->samples;
+    PyObject_Del(self);
+}
+
+static PyBufferProcs blockViewBuffer;
+static PyTypeObject blockViewType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+static void readyBlockView()
+{
+    blockViewBuffer.bf_getbuffer = getBlockBuffer;
+    blockViewType.tp_name = "libcore.BlockView";
+    blockViewType.tp_basicsize = sizeof(BlockView);
+    blockViewType.tp_dealloc = deleteBlockView;
+    blockViewType.tp_as_buffer = &blockViewBuffer;
+#ifdef Py_TPFLAGS_HAVE_NEWBUFFER
+    blockViewType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#else
+    blockViewType.tp_flags = Py_TPFLAGS_DEFAULT;
+#endif
+    PyType_Ready(&blockViewType);
+}
+
+object UGen::view(shared_array<Sample> samples, int channels, int blockSize, int offset, int frames)
+{
+    BlockView *block = PyObject_New(BlockView, &blockViewType);
+    block->samples = new shared_array<Sample>(samples);
+    block->data = samples.get() + offset;
+    block->shape[0] = channels;
+    block->shape[1] = frames;
+    block->strides[0] = blockSize * sizeof(Sample);
+    block->strides[1] = sizeof(Sample);
+
+    object exporter = object(handle<>((PyObject*) block));
+    return object(handle<>(PyMemoryView_FromObject(exporter.ptr())));
+}
+
+unsigned long UGen::getCpu()
+{
+    return cpu.get();
+}
+
+// while the stream runs, the blocks of io are the device buffers, which
+// RtAudio frees when it stops: a view could not keep them alive
+static void checkBound(Sample *block, shared_array<Sample> const& own)
+{
+    if (block != own.get()) {
+        PyErr_SetString(PyExc_BufferError, "io is bound to the audio device, stop the server first");
+        throw_error_already_set();
+    }
+}
+
+object UGen::getInputs()
+{
+    ServerPtr s = Server::singleton;
+    if (s && s->io.get() == this) {
+        checkBound(input.get(), s->ioInput);
+    }
+    return view(input, inputSize, blockSize, 0, blockSize);
 }
 
-void UGen::resetOutput()
+object UGen::getOutputs()
 {
-    for (int o=0; o<outputSize; o++) {
-        output[o] = 0.0f;
-    }    
+    ServerPtr s = Server::singleton;
+    if (s && s->io.get() == this) {
+        checkBound(output.get(), s->ioOutput);
+    }
+    return view(output, outputSize, blockSize, 0, blockSize);
 }
 
 void UGen::addSource(UGenPtr source)
@@ -119,11 +382,25 @@ void UGen::addSource(UGenPtr source)
 void UGen::addSourceRoute(UGenPtr source, RoutePtr route)
 {
     // BUGFIX boost::python doing nasty things with shared_ptr
-    weak_ptr<UGen> u(source->shared_from_this());
-    this->sources[u] = route;
+    UGenPtr u = source->shared_from_this();
+
+    pruneSources();
+    for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (it->ugen.lock() == u) {
+            it->route = route;
+            Server::invalidate();
+            return;
+        }
+    }
+
+    Source s;
+    s.ugen = u;
+    s.route = route;
+    sources.push_back(s);
+    Server::invalidate();
 }
 
-void UGen::addSourceList(UGenPtr source, list route)
+void UGen::addSourceList(UGenPtr source, boost::python::list route)
 {
     // FIXME build a route from a python list
 }
@@ -131,49 +408,224 @@ void UGen::addSourceList(UGenPtr source, list route)
 void UGen::removeSource(UGenPtr source)
 {
     // BUGFIX boost::python doing nasty things with shared_ptr
-    weak_ptr<UGen> u(source->shared_from_this());
-    this->sources.erase(u);
+    UGenPtr u = source->shared_from_this();
+
+    pruneSources();
+    for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (it->ugen.lock() == u) {
+            sources.erase(it);
+            Server::invalidate();
+            return;
+        }
+    }
+}
+
+void UGen::forgetSource(UGen *source)
+{
+    for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (it->ugen.lock().get() == source) {
+            sources.erase(it);
+            return;
+        }
+    }
 }
 
-void UGen::tick()
+void UGen::pruneSources()
 {
-    if (this->last < Server::singleton->now) {
-        this->last = Server::singleton->now;
-        this->fetch();
-        this->compute();
+    // forget the sources that do not exist anymore. this is only done from
+    // the control side, never while the graph is running.
+    SourceList::iterator last = sources.begin();
+    for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+        if (!it->ugen.expired()) {
+            *last++ = *it;
+        }
     }
+    sources.erase(last, sources.end());
+}
+
+void UGen::init()
+{
+    // doing nothing, should be overridden in subclass
+}
+
+void UGen::tick(int offset, int frames)
+{
+    this->fetch(offset, frames);
+    this->process(offset, frames);
+    this->position = offset + frames;
 }
 
-void UGen::fetch()
+void UGen::fetch(int offset, int frames)
 {
-    resetInput();
+    resetInput(offset, frames);
 
-    // for each source
+    // mix the current output of each source. evaluation order is handled by
+    // the server's schedule, so sources are not ticked from here.
     for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
-        UGenPtr source = it->first.lock();
-        RoutePtr route = it->second;
-        UGenPtr target = shared_from_this();
-        if (source) {
-            // propagate evaluation
-            source->tick();
-            route->fetch(source,target);
-        } else {
-            // source does not exist, remove
-            sources.erase(it);
+        UGenPtr source = it->ugen.lock();
+        if (source && !source->silent) {
+            it->route->fetch(source.get(), this, offset, frames);
         }
     }
 }
 
-void UGen::compute()
+void UGen::process(int offset, int frames)
 {
     // doing nothing, should be overridden in subclass
 }
 
+void UGen::store(int offset, int frames, bool silentInput)
+{
+    // only feedback nodes keep their input
+}
+
+bool UGen::quiet(bool silentInput)
+{
+    // nothing is known about subclasses
+    return false;
+}
+
+bool UGen::gateOpen(int index)
+{
+    return true;
+}
+
+void UGen::connect()
+{}
+
+bool UGen::release(UGenPtr& owner)
+{
+    return owner.unique();
+}
+
+bool UGen::getSilent()
+{
+    return silent;
+}
+
+void UGen::queue(Command *command)
+{
+    command->next = NULL;
+    if (lastQueued) {
+        lastQueued->next = command;
+    } else {
+        queued = command;
+    }
+    lastQueued = command;
+}
+
+void UGen::run(Time time, int offset, int frames)
+{
+    // time of the first frame of the block
+    Time origin = time - offset;
+    int end = offset + frames;
+
+    while (queued) {
+        Command *command = queued;
+        int at = offset;
+        if (origin + offset < command->time) {
+            at = command->time - origin;
+        }
+        if (offset < at) {
+            process(offset, at - offset);
+            offset = at;
+        }
+
+        queued = command->next;
+        if (!queued) {
+            lastQueued = NULL;
+        }
+        command->apply();
+    }
+
+    if (offset < end) {
+        process(offset, end - offset);
+    }
+    position = end;
+}
+
+// PythonUGen class
+///////////////////////////////////////////////////////////////////////////////
+
+PythonUGen::PythonUGen(int inputs, int outputs)
+: UGen(inputs, outputs)
+{
+    this->pinned = true;
+    this->viewed = NULL;
+    this->failed = false;
+}
+
+PythonUGen::~PythonUGen()
+{}
+
+bool PythonUGen::quiet(bool silentInput)
+{
+    // read without the GIL: both only change towards sleeping
+    return failed || !self;
+}
+
+void PythonUGen::connect()
+{
+    PyObject *owner = python::detail::wrapper_base_::get_owner(*this);
+    if (!self && owner) {
+        self = handle<>(borrowed(owner));
+    }
+}
+
+bool PythonUGen::release(UGenPtr& owner)
+{
+    // dropped everywhere but here: the python object holds the other
+    // reference to the node. letting it go gives the node back to the
+    // schedule, and process() stops calling into it.
+    if (self && self.get()->ob_refcnt == 1 && owner.use_count() == 2) {
+        self.reset();
+    }
+    return owner.unique();
+}
+
+void PythonUGen::process(int offset, int frames)
+{
+    PyGILState_STATE state = Server::singleton->metrics.ensure();
+
+    // the wrapper reads its borrowed reference: only look the override up
+    // while self keeps it valid
+    if (!self || failed) {
+        resetOutput(offset, frames);
+        PyGILState_Release(state);
+        return;
+    }
+
+    try {
+        override process = this->get_override("process");
+        if (process) {
+            if (offset == 0 && frames == blockSize) {
+                if (viewed != input.get()) {
+                    inputs = view(input, inputSize, blockSize, 0, blockSize);
+                    outputs = view(output, outputSize, blockSize, 0, blockSize);
+                    viewed = input.get();
+                }
+                process(inputs, outputs);
+            } else {
+                process(view(input, inputSize, blockSize, offset, frames),
+                        view(output, outputSize, blockSize, offset, frames));
+            }
+        }
+    } catch (const error_already_set& e) {
+        // reported once: the node is silenced rather than failing every block
+        PyErr_Print();
+        resetOutput(offset, frames);
+        failed = true;
+    }
+
+    PyGILState_Release(state);
+}
+
 // Route class
 ///////////////////////////////////////////////////////////////////////////////
 
 Route::Route(int sourceSize, int targetSize)
 {
+    checkChannels(sourceSize, targetSize);
     this->sourceSize = sourceSize;
     this->targetSize = targetSize;
     init();
@@ -186,23 +638,24 @@ Route::Route(UGenPtr source, UGenPtr target)
     init();
 }
 
-Route::Route(list weights)
+Route::Route(boost::python::list weights)
 {
     sourceSize = len(weights);
     targetSize = len(weights[0]);
 
-    this->weights = shared_array<int>(new int[sourceSize * targetSize]);
+    this->weights = Arena::samples(Arena::product(sourceSize, targetSize));
 
     for (int i=0; i<sourceSize; i++) {
         for (int j=0; j<targetSize; j++) {
-            this->weights[i*targetSize + j] = extract<int>(weights[i][j]);
+            this->weights[i*targetSize + j] = extract<Sample>(weights[i][j]);
         }
     }
+    classify();
 }
 
 void Route::init()
 {
-    weights = shared_array<int>(new int[sourceSize * targetSize]);
+    weights = Arena::samples(Arena::product(sourceSize, targetSize));
 
     if (sourceSize == targetSize) {
         // 1->1
@@ -218,146 +671,1261 @@ void Route::init()
             weights[i] = 1;
         }
     }
+    classify();
 }
 
-Route::~Route()
-{}
-
-void Route::fetch(UGenPtr source, UGenPtr target)
+void Route::classify()
 {
-    for (int i=0; i<sourceSize; i++) {
-        for (int j=0; j<targetSize; j++) {
-            target->input[j] += source->output[i] * weights[i*targetSize+j];
+    bool zero = true;
+    for (int i=0; i<sourceSize*targetSize; i++) {
+        if (weights[i] != 0) {
+            zero = false;
+        }
+    }
+
+    if (zero) {
+        kind = MUTE;
+    } else if (sourceSize == 1) {
+        kind = BROADCAST;
+    } else if (targetSize == 1) {
+        kind = SUMDOWN;
+    } else if (sourceSize == targetSize) {
+        kind = IDENTITY;
+        for (int i=0; i<sourceSize; i++) {
+            for (int j=0; j<targetSize; j++) {
+                if (i != j && weights[i*targetSize + j] != 0) {
+                    kind = DENSE;
+                }
+            }
         }
+    } else {
+        kind = DENSE;
     }
 }
 
-// Shred class
-///////////////////////////////////////////////////////////////////////////////
+Route::~Route()
+{}
 
-Shred::Shred(object gen, Time t)
+void *Route::operator new(size_t bytes)
 {
-    this->next = t;
-    this->gen = gen;
+    return Arena::instance().allocate(bytes);
 }
 
-Shred::Shred(object gen)
+void Route::operator delete(void *block, size_t bytes)
 {
-    this->next = Server::singleton->now;
-    this->gen = gen;
+    Arena::instance().release(block, bytes);
 }
 
-Shred::~Shred()
+Sample Route::getGain(int source, int target)
 {
-    kill();
+    return weights[source*targetSize + target];
 }
 
-void Shred::run()
+void Route::setGain(int source, int target, Sample gain)
 {
-    // resume the shred and store the result sent by yield
-    try {
-        object yield = gen.attr("next")();
-        handleYield(yield);
-    } catch (const error_already_set& e) {
-        // StopIteration error means the shred is finished, so we don't have to
-        // reshredule it later.
-    }
+    weights[source*targetSize + target] = gain;
+    classify();
+    // schedules hold a copy of the weights
+    Server::invalidate();
 }
 
-void Shred::run(object args)
+void Route::fetch(UGen *source, UGen *target, int offset, int frames)
 {
-    try {
-        object yield = gen.attr("send")(args);
-        handleYield(yield);
-    } catch (const error_already_set& e) {
-        // StopIteration error means the shred is finished, so we don't have to
-        // reshredule it later.	
-    }
+    Kernel mix = kernel(kind, sourceSize, targetSize);
+    mix(kind, weights.get(), sourceSize, targetSize, source, target, offset, frames);
 }
 
-void Shred::handleYield(object yield)
+// out += in * gain, skipping the multiplication (or everything) when possible
+static inline void mixChannel(Sample *out, Sample const *in, Sample gain, int frames)
 {
-    ServerPtr s = Server::singleton;
-    // yield returned None -> reshredule now
-    if (yield.is_none()) {
-        next = s->now;
-        s->addShred(shared_from_this());
-        return;
-    }
-
-    // yield returned a duration -> reshredule now+duration
-    extract<Duration> get_dur(yield);
-    if (get_dur.check()) {
-        next = s->now + get_dur();
-        s->addShred(shared_from_this());
-        return;
-    }
-
-    // yield returned an Event object -> reshredule in event queue
-    extract<EventPtr> get_event(yield);
-    if (get_event.check()) {
-        next = s->now;
-        get_event()->addShred(shared_from_this());
-        return;
+    if (gain == 1) {
+        mixAdd(out, in, frames);
+    } else if (gain != 0) {
+        mixScaled(out, in, gain, frames);
     }
 }
 
-void Shred::kill()
+void Route::mix(int kind, Sample const* weights, int sourceSize, int targetSize,
+        UGen *source, UGen *target, int offset, int frames)
 {
-    gen.attr("close")();
-}
+    int ss = source->blockSize;
+    int ts = target->blockSize;
+    Sample *in = &source->output[offset];
+    Sample *out = &target->input[offset];
 
-// Event class
-///////////////////////////////////////////////////////////////////////////////
+    switch (kind) {
+    case MUTE:
+        break;
 
-Event::Event()
-{}
+    case IDENTITY:
+        for (int i=0; i<sourceSize; i++) {
+            mixChannel(out + i*ts, in + i*ss, weights[i*targetSize + i], frames);
+        }
+        break;
 
-Event::~Event()
-{}
+    case BROADCAST:
+        for (int j=0; j<targetSize; j++) {
+            mixChannel(out + j*ts, in, weights[j], frames);
+        }
+        break;
 
-void Event::addShred(ShredPtr shred)
+    case SUMDOWN:
+        for (int i=0; i<sourceSize; i++) {
+            mixChannel(out, in + i*ss, weights[i], frames);
+        }
+        break;
+
+    default:
+        for (int i=0; i<sourceSize; i++) {
+            for (int j=0; j<targetSize; j++) {
+                mixChannel(out + j*ts, in + i*ss, weights[i*targetSize + j], frames);
+            }
+        }
+    }
+}
+
+// the same mix for a fixed number of channels: the loops over channels are
+// unrolled, and a stereo source is mixed into each target channel in a
+// single pass.
+template <int S, int T>
+static void mixFixed(int kind, Sample const* weights, int sourceSize, int targetSize,
+        UGen *source, UGen *target, int offset, int frames)
+{
+    Sample *in = &source->output[offset];
+    Sample *out = &target->input[offset];
+    int ss = source->blockSize;
+    int ts = target->blockSize;
+
+    for (int j=0; j<T; j++) {
+        if (S == 2 && weights[j] != 0 && weights[T + j] != 0) {
+            mixPair(out + j*ts, in, weights[j], in + ss, weights[T + j], frames);
+        } else {
+            for (int i=0; i<S; i++) {
+                mixChannel(out + j*ts, in + i*ss, weights[i*T + j], frames);
+            }
+        }
+    }
+}
+
+Route::Kernel Route::kernel(int kind, int sourceSize, int targetSize)
+{
+    if (kind != MUTE && sourceSize <= 2 && targetSize <= 2) {
+        switch (sourceSize*2 + targetSize) {
+        case 3: return &mixFixed<1,1>;
+        case 4: return &mixFixed<1,2>;
+        case 5: return &mixFixed<2,1>;
+        case 6: return &mixFixed<2,2>;
+        }
+    }
+    return &Route::mix;
+}
+
+// Schedule class
+///////////////////////////////////////////////////////////////////////////////
+
+void Schedule::compile(UGenPtr root, int blockSize)
+{
+    time = 0;
+    next = NULL;
+    owners.clear();
+    nodes.clear();
+    first.clear();
+    edges.clear();
+    weights.clear();
+    delays.clear();
+    gates.clear();
+
+    // order the nodes so that each one comes after all its sources, but for
+    // the sources of feedback nodes
+    map<UGen*, int> index;
+    visit(root, index);
+    partition(index);
+
+    // then lay the edges out contiguously, in the same order. a cycle
+    // without a feedback node is kept as is: its last node reads the output
+    // of the previous range.
+    for (size_t i=0; i<nodes.size(); i++) {
+        // a node made before the server has blocks of the default size. it
+        // is not running yet, so its blocks can be replaced.
+        if (nodes[i]->blockSize != blockSize) {
+            nodes[i]->allocate(blockSize);
+        }
+        if (nodes[i]->feedback) {
+            delays.push_back(i);
+        }
+        UGen *gate = nodes[i]->gate;
+        gates.push_back(gate && index.count(gate) ? index[gate] : -1);
+        first.push_back(edges.size());
+        SourceList& sources = nodes[i]->sources;
+        for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+            UGenPtr source = it->ugen.lock();
+            if (!source) {
+                continue;
+            }
+            RoutePtr route = it->route;
+            Edge edge;
+            edge.source = index[source.get()];
+            edge.kind = route->kind;
+            edge.mix = Route::kernel(route->kind, route->sourceSize, route->targetSize);
+            edge.sourceSize = route->sourceSize;
+            edge.targetSize = route->targetSize;
+            edge.weights = weights.size();
+            weights.insert(weights.end(), route->weights.get(), 
+                    route->weights.get() + route->sourceSize * route->targetSize);
+            edges.push_back(edge);
+        }
+    }
+    first.push_back(edges.size());
+}
+
+void Schedule::visit(UGenPtr ugen, map<UGen*, int>& index)
+{
+    // -1 marks a node being visited
+    index[ugen.get()] = -1;
+
+    // a feedback node does not wait for its sources: it comes first, so
+    // that the cycles going through it are broken
+    if (ugen->feedback) {
+        index[ugen.get()] = nodes.size();
+        owners.push_back(ugen);
+        nodes.push_back(ugen.get());
+        ugen->connect();
+    }
+
+    SourceList& sources = ugen->sources;
+    for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+        UGenPtr source = it->ugen.lock();
+        if (source && !index.count(source.get())) {
+            visit(source, index);
+        }
+    }
+
+    if (!ugen->feedback) {
+        index[ugen.get()] = nodes.size();
+        owners.push_back(ugen);
+        nodes.push_back(ugen.get());
+        ugen->connect();
+    }
+}
+
+bool Schedule::release()
+{
+    // a node only referenced by the schedule has been dropped everywhere
+    // else: sources are weak references, so it must leave the graph. the
+    // schedule keeps it alive, so it has to be removed from its targets.
+    bool found = false;
+    for (size_t i=0; i<owners.size(); i++) {
+        if (owners[i]->release(owners[i])) {
+            for (size_t j=0; j<nodes.size(); j++) {
+                nodes[j]->forgetSource(nodes[i]);
+            }
+            found = true;
+        }
+    }
+    return found;
+}
+
+static int findGroup(vector<int>& group, int i)
+{
+    while (group[i] != i) {
+        group[i] = group[group[i]];
+        i = group[i];
+    }
+    return i;
+}
+
+void Schedule::partition(map<UGen*, int>& index)
+{
+    // nodes linked by an edge end up in the same group. the root is left
+    // out: reading its output does not tie subgraphs together.
+    int count = nodes.size() - 1;
+    vector<int> group(count);
+    for (int i=0; i<count; i++) {
+        group[i] = i;
+    }
+    for (int i=0; i<count; i++) {
+        SourceList& sources = nodes[i]->sources;
+        for (SourceList::iterator it = sources.begin(); it != sources.end(); ++it) {
+            UGenPtr source = it->ugen.lock();
+            if (!source || index[source.get()] == count) {
+                continue;
+            }
+            group[findGroup(group, i)] = findGroup(group, index[source.get()]);
+        }
+    }
+
+    // number the groups, the biggest first so that the small ones fill the
+    // gaps at the end of a block. the pinned ones go last.
+    vector<int> size(count, 0);
+    vector<int> pin(count, 0);
+    for (int i=0; i<count; i++) {
+        size[findGroup(group, i)]++;
+        if (nodes[i]->pinned) {
+            pin[findGroup(group, i)] = 1;
+        }
+    }
+    vector< pair< pair<int, int>, int> > order;
+    for (int i=0; i<count; i++) {
+        if (group[i] == i) {
+            order.push_back(make_pair(make_pair(pin[i], -size[i]), i));
+        }
+    }
+    sort(order.begin(), order.end());
+    map<int, int> task;
+    tasks.clear();
+    pinned = order.size();
+    int start = 0;
+    for (size_t k=0; k<order.size(); k++) {
+        task[order[k].second] = k;
+        tasks.push_back(start);
+        start += size[order[k].second];
+        if (order[k].first.first && pinned == (int) order.size()) {
+            pinned = k;
+        }
+    }
+    tasks.push_back(count);
+
+    // then reorder the nodes, keeping their order within a group
+    vector<UGenPtr> sorted(nodes.size());
+    vector<int> next(tasks);
+    for (int i=0; i<count; i++) {
+        sorted[next[task[findGroup(group, i)]]++] = owners[i];
+    }
+    sorted[count] = owners[count];
+
+    owners = sorted;
+    for (size_t i=0; i<owners.size(); i++) {
+        nodes[i] = owners[i].get();
+        index[nodes[i]] = i;
+    }
+}
+
+void Schedule::run(Time time, int offset, int frames)
+{
+    // the subgraphs, in parallel when possible, then the root
+    Pool& pool = Server::singleton->pool;
+    if (pool.size() && pinned > 1) {
+        pool.run(this, time, offset, frames);
+    } else {
+        runNodes(0, tasks.back(), time, offset, frames);
+    }
+    runNodes(tasks.back(), nodes.size(), time, offset, frames);
+
+    // the feedback nodes keep their input for the next ranges. any node,
+    // the root included, may feed them.
+    for (size_t d=0; d<delays.size(); d++) {
+        int i = delays[d];
+        bool silentInput = mixInputs(i, offset, frames);
+        nodes[i]->store(offset, frames, silentInput);
+    }
+}
+
+void Schedule::runTask(int task, Time time, int offset, int frames)
+{
+    runNodes(tasks[task], tasks[task+1], time, offset, frames);
+}
+
+void Schedule::runNodes(int begin, int end, Time time, int offset, int frames)
+{
+    bool profiling = Server::singleton->metrics.profiling;
+    for (int i=begin; i<end; i++) {
+        UGen *ugen = nodes[i];
+        // the input of a feedback node is mixed later on, by run(). a closed
+        // gate leaves the input alone, unless commands wake the node up.
+        bool closed = gated(i);
+        bool silentInput = ugen->feedback || (closed && !ugen->queued)
+            || mixInputs(i, offset, frames);
+
+        // a quiet node falls asleep with a silent output, and stays so while
+        // nothing changes. commands wake it up, so that they are applied.
+        // the output of the root is the device input, written before the
+        // block: it never sleeps.
+        bool root = i == (int) nodes.size() - 1;
+        if (!ugen->queued && !root && (closed || ugen->quiet(silentInput))) {
+            if (!ugen->silent) {
+                ugen->resetOutput(0, ugen->blockSize);
+                ugen->silent = true;
+            }
+            ugen->position = offset + frames;
+            continue;
+        }
+        ugen->silent = false;
+
+        if (profiling) {
+            unsigned long start = Metrics::nanoseconds();
+            ugen->run(time, offset, frames);
+            ugen->cpu.add(Metrics::nanoseconds() - start);
+        } else {
+            ugen->run(time, offset, frames);
+        }
+    }
+}
+
+// whether the gate of a node is closed. the gate is a node of the schedule,
+// so that it lives as long as the schedule.
+bool Schedule::gated(int node)
+{
+    if (gates[node] == -1) {
+        return false;
+    }
+    UGen *gate = nodes[gates[node]];
+    return !gate->queued && !gate->gateOpen(nodes[node]->gateIndex);
+}
+
+// mix the edges feeding a node into its input. returns whether the input is
+// silent.
+bool Schedule::mixInputs(int node, int offset, int frames)
+{
+    UGen *ugen = nodes[node];
+    ugen->resetInput(offset, frames);
+    bool silentInput = true;
+    for (int e=first[node]; e<first[node+1]; e++) {
+        Edge& edge = edges[e];
+        if (edge.kind == Route::MUTE || nodes[edge.source]->silent) {
+            continue;
+        }
+        edge.mix(edge.kind, &weights[edge.weights], edge.sourceSize, edge.targetSize,
+                nodes[edge.source], ugen, offset, frames);
+        silentInput = false;
+    }
+    return silentInput;
+}
+
+// Pool class
+///////////////////////////////////////////////////////////////////////////////
+
+Pool::Pool()
+{
+    alive = false;
+    ticket = 0;
+    done = 0;
+    sleeping = 0;
+    tuned = false;
+    policy = SCHED_OTHER;
+    priority = 0;
+    schedule = NULL;
+    time = 0;
+    offset = 0;
+    frames = 0;
+}
+
+Pool::~Pool()
+{
+    stop();
+}
+
+int Pool::size()
+{
+    return threads.size();
+}
+
+void Pool::start(int size)
+{
+    alive = true;
+    tuned = false;
+    for (int i=0; i<size; i++) {
+        threads.push_back(boost::shared_ptr<boost::thread>(
+                    new boost::thread(&Pool::work, this)));
+    }
+}
+
+void Pool::stop()
+{
+    alive = false;
+    wake.notify_all();
+    for (size_t i=0; i<threads.size(); i++) {
+        threads[i]->join();
+    }
+    threads.clear();
+}
+
+void Pool::run(Schedule *schedule, Time time, int offset, int frames)
+{
+    if (!tuned) {
+        sched_param param;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        priority = param.sched_priority;
+        tuned = true;
+    }
+
+    int count = schedule->pinned;
+    this->schedule = schedule;
+    this->time = time;
+    this->offset = offset;
+    this->frames = frames;
+    done = 0;
+    ticket = (boost::uint64_t) count << 32;
+    if (sleeping) {
+        wake.notify_all();
+    }
+
+    // the audio thread runs the pinned subgraphs, works on the others too,
+    // then waits for the tasks still running
+    schedule->runNodes(schedule->tasks[count], schedule->tasks.back(), time, offset, frames);
+    help();
+    while (done < count) {
+        boost::this_thread::yield();
+    }
+}
+
+bool Pool::help()
+{
+    // a task claimed in a batch keeps the batch from completing, so its
+    // description can be read safely once claimed
+    bool worked = false;
+    boost::uint64_t t = ticket;
+    while ((t & 0xffffffff) < (t >> 32)) {
+        if (!ticket.compare_exchange_weak(t, t + 1)) {
+            continue;
+        }
+        schedule->runTask(t & 0xffffffff, time, offset, frames);
+        done++;
+        worked = true;
+        t = ticket;
+    }
+    return worked;
+}
+
+void Pool::work()
+{
+    // spin for a while after a batch, then wait. a missed wake up only
+    // means the other threads do the work.
+    bool matched = false;
+    int idle = 0;
+    while (alive) {
+        if (tuned && !matched) {
+            // best effort: as realtime as the audio thread, no more
+            sched_param param;
+            param.sched_priority = priority;
+            pthread_setschedparam(pthread_self(), policy, &param);
+            matched = true;
+        }
+
+        if (help()) {
+            idle = 0;
+        } else if (idle < 1000) {
+            idle++;
+            boost::this_thread::yield();
+        } else {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            sleeping++;
+            wake.timed_wait(lock, boost::posix_time::milliseconds(1));
+            sleeping--;
+        }
+    }
+}
+
+// Metrics class
+///////////////////////////////////////////////////////////////////////////////
+
+Metrics::Metrics()
+{
+    profiling = false;
+}
+
+unsigned long Metrics::nanoseconds()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000UL + t.tv_nsec;
+}
+
+void Metrics::reset()
+{
+    callbacks.set(0);
+    for (int b=0; b<buckets; b++) {
+        histogram[b].set(0);
+    }
+    busy.set(0);
+    worst.set(0);
+    underflows.set(0);
+    overflows.set(0);
+    gilWait.set(0);
+    gilTaken.set(0);
+    blocks.set(0);
+    shreds.set(0);
+    mostShreds.set(0);
+}
+
+void Metrics::cycle(unsigned long elapsed, unsigned long deadline)
+{
+    callbacks.add(1);
+    busy.add(elapsed);
+    worst.raise(elapsed);
+
+    int b = buckets - 1;
+    if (elapsed < deadline) {
+        b = elapsed * (buckets - 1) / deadline;
+    }
+    histogram[b].add(1);
+}
+
+PyGILState_STATE Metrics::ensure()
+{
+    unsigned long start = nanoseconds();
+    PyGILState_STATE state = PyGILState_Ensure();
+    gilWait.add(nanoseconds() - start);
+    gilTaken.add(1);
+    return state;
+}
+
+// Param class
+///////////////////////////////////////////////////////////////////////////////
+
+Param::Param(float value)
+{
+    this->value = value;
+    this->target = value;
+    this->mode = FIXED;
+    this->step = 0;
+    this->remaining = 0;
+}
+
+void Param::ramp(int mode, float target, Duration frames)
+{
+    this->target = target;
+    this->mode = mode;
+
+    // exponential curves need both ends on the same side of zero
+    if (mode == EXPONENTIAL && !(value * target > 0)) {
+        this->mode = LINEAR;
+    }
+
+    if (frames == 0) {
+        this->value = target;
+        this->mode = FIXED;
+    } else if (this->mode == LINEAR) {
+        step = (target - value) / (double) frames;
+        remaining = frames;
+    } else if (this->mode == EXPONENTIAL) {
+        step = pow(target / (double) value, 1.0 / frames);
+        remaining = frames;
+    } else if (this->mode == SMOOTH) {
+        // frames is the time constant of the one-pole filter
+        step = exp(-1.0 / frames);
+    }
+}
+
+void Param::advance(int frames)
+{
+    switch (mode) {
+        case LINEAR:
+        case EXPONENTIAL:
+            if (remaining <= (Duration) frames) {
+                value = target;
+                mode = FIXED;
+            } else if (mode == LINEAR) {
+                value += step * frames;
+                remaining -= frames;
+            } else {
+                value *= pow(step, frames);
+                remaining -= frames;
+            }
+            break;
+        case SMOOTH:
+            value = target + (value - target) * pow(step, frames);
+            if (std::fabs(value - target) <= 1e-5 * std::max(std::fabs(target), 1.0f)) {
+                value = target;
+                mode = FIXED;
+            }
+            break;
+    }
+}
+
+ParamRef::ParamRef(UGenPtr ugen, Param *param, Check check)
+{
+    this->ugen = ugen;
+    this->param = param;
+    this->check = check;
+}
+
+float ParamRef::getValue()
+{
+    return param->value;
+}
+
+float ParamRef::getTarget()
+{
+    return param->target;
+}
+
+bool ParamRef::moving()
+{
+    return param->moving();
+}
+
+void ParamRef::validate(float value)
+{
+    if (check && !check(value)) {
+        PyErr_SetString(PyExc_ValueError, "invalid target for this parameter");
+        throw_error_already_set();
+    }
+}
+
+void ParamRef::rampTo(float value, Duration frames)
+{
+    validate(value);
+    Server::post(new RampCommand(ugen, param, Param::LINEAR, value, frames));
+}
+
+void ParamRef::expTo(float value, Duration frames)
+{
+    validate(value);
+    // the curve never reaches nor crosses zero
+    if (!(value * param->value > 0)) {
+        PyErr_SetString(PyExc_ValueError, "an exponential ramp stays on one side of zero");
+        throw_error_already_set();
+    }
+    Server::post(new RampCommand(ugen, param, Param::EXPONENTIAL, value, frames));
+}
+
+void ParamRef::smooth(float value, Duration frames)
+{
+    validate(value);
+    Server::post(new RampCommand(ugen, param, Param::SMOOTH, value, frames));
+}
+
+// python arithmetic on parameter handles works on their current value
+float paramAdd(ParamRef& p, float x) { return p.getValue() + x; }
+float paramSub(ParamRef& p, float x) { return p.getValue() - x; }
+float paramRsub(ParamRef& p, float x) { return x - p.getValue(); }
+float paramMul(ParamRef& p, float x) { return p.getValue() * x; }
+float paramDiv(ParamRef& p, float x) { return p.getValue() / x; }
+float paramRdiv(ParamRef& p, float x) { return x / p.getValue(); }
+
+// and so do comparisons, so that osc.freq == 440 keeps working
+static object paramCompare(ParamRef& p, object x, int op)
+{
+    return object(handle<>(PyObject_RichCompare(object(p.getValue()).ptr(), x.ptr(), op)));
+}
+object paramEq(ParamRef& p, object x) { return paramCompare(p, x, Py_EQ); }
+object paramNe(ParamRef& p, object x) { return paramCompare(p, x, Py_NE); }
+object paramLt(ParamRef& p, object x) { return paramCompare(p, x, Py_LT); }
+object paramLe(ParamRef& p, object x) { return paramCompare(p, x, Py_LE); }
+object paramGt(ParamRef& p, object x) { return paramCompare(p, x, Py_GT); }
+object paramGe(ParamRef& p, object x) { return paramCompare(p, x, Py_GE); }
+object paramRepr(ParamRef& p) { return object(p.getValue()).attr("__repr__")(); }
+
+// Command classes
+///////////////////////////////////////////////////////////////////////////////
+
+Command::Command()
+{
+    time = 0;
+    next = NULL;
+}
+
+Command::~Command()
+{}
+
+UGen *Command::target()
+{
+    return NULL;
+}
+
+ShredCommand::ShredCommand(ShredPtr shred)
+{
+    this->shred = shred;
+}
+
+void ShredCommand::apply()
+{
+    Server::singleton->queue.push(shred);
+}
+
+RampCommand::RampCommand(UGenPtr ugen, Param *param, int mode, float value, Duration frames)
+{
+    this->ugen = ugen;
+    this->param = param;
+    this->mode = mode;
+    this->value = value;
+    this->frames = frames;
+}
+
+void RampCommand::apply()
+{
+    param->ramp(mode, value, frames);
+    ugen->init();
+}
+
+UGen *RampCommand::target()
+{
+    return ugen.get();
+}
+
+// Shred class
+///////////////////////////////////////////////////////////////////////////////
+
+Shred::Shred(object gen, Time t)
+{
+    this->next = t;
+    this->gen = gen;
+}
+
+Shred::Shred(object gen)
+{
+    this->next = Server::singleton->getNow();
+    this->gen = gen;
+}
+
+Shred::~Shred()
+{
+    kill();
+}
+
+// while a shred runs, the server's logical time is the time the shred woke
+// up at, which may be ahead of the audio clock
+struct ShredContext
+{
+    Server *server;
+    Time now;
+    Time *outer; // time of the shred that ran this one, if any
+
+    ShredContext(Time t)
+    {
+        server = Server::singleton.get();
+        now = t;
+        outer = server->shredTime.get();
+        server->shredTime.reset(&now);
+    }
+
+    ~ShredContext()
+    {
+        // the changes made by the shred take effect at its logical time
+        if (server->dirty) {
+            server->compile();
+        }
+        server->shredTime.reset(outer);
+    }
+};
+
+void Shred::run()
+{
+    ShredContext context(next);
+
+    // resume the shred and store the result sent by yield
+    try {
+        object yield = gen.attr("next")();
+        handleYield(yield);
+    } catch (const error_already_set& e) {
+        // StopIteration error means the shred is finished, so we don't have to
+        // reshredule it later.
+    }
+}
+
+void Shred::run(object args)
+{
+    ShredContext context(next);
+
+    try {
+        object yield = gen.attr("send")(args);
+        handleYield(yield);
+    } catch (const error_already_set& e) {
+        // StopIteration error means the shred is finished, so we don't have to
+        // reshredule it later.	
+    }
+}
+
+void Shred::handleYield(object yield)
+{
+    ServerPtr s = Server::singleton;
+    // yield returned None -> reshredule now
+    if (yield.is_none()) {
+        next = s->getNow();
+        s->addShred(shared_from_this());
+        return;
+    }
+
+    // yield returned a duration -> reshredule now+duration
+    extract<Duration> get_dur(yield);
+    if (get_dur.check()) {
+        next = s->getNow() + get_dur();
+        s->addShred(shared_from_this());
+        return;
+    }
+
+    // yield returned an Event object -> reshredule in event queue
+    extract<EventPtr> get_event(yield);
+    if (get_event.check()) {
+        next = s->getNow();
+        get_event()->addShred(shared_from_this());
+        return;
+    }
+}
+
+void Shred::kill()
+{
+    if (!gen.is_none()) {
+        gen.attr("close")();
+    }
+}
+
+// NativeShred class
+///////////////////////////////////////////////////////////////////////////////
+
+NativeShred::NativeShred()
+: Shred(object())
+{
+    waiting = NOW;
+    duration = 0;
+    dead = false;
+}
+
+NativeShred::~NativeShred()
+{}
+
+void NativeShred::run()
+{
+    run(object());
+}
+
+void NativeShred::run(object args)
+{
+    if (dead || is_complete()) {
+        return;
+    }
+
+    ShredContext context(next);
+    ServerPtr s = Server::singleton;
+
+    received = args;
+    waiting = NOW;
+    resume();
+    received = object();
+
+    // leaving the reenter block without a yield ends the shred
+    if (is_complete()) {
+        return;
+    }
+
+    switch (waiting) {
+    case NOW:
+        next = s->getNow();
+        s->addShred(shared_from_this());
+        break;
+    case SLEEP:
+        next = s->getNow() + duration;
+        s->addShred(shared_from_this());
+        break;
+    case EVENT:
+        next = s->getNow();
+        event->addShred(shared_from_this());
+        event.reset();
+        break;
+    }
+}
+
+void NativeShred::kill()
+{
+    dead = true;
+}
+
+void NativeShred::sleep(Duration duration)
+{
+    this->waiting = SLEEP;
+    this->duration = duration;
+}
+
+void NativeShred::wait(EventPtr event)
+{
+    this->waiting = EVENT;
+    this->event = event;
+}
+
+bool NativeShred::isDone()
+{
+    return dead || is_complete();
+}
+
+// Event class
+///////////////////////////////////////////////////////////////////////////////
+
+Event::Event()
+{}
+
+Event::~Event()
+{}
+
+void Event::addShred(ShredPtr shred)
 {
     queue.push(shred);
 }
 
-void Event::broadcast(object args)
+void Event::broadcast(object args)
+{
+    // wake up all shreds that are waiting for this event. if a shred finish by
+    // waiting for this event again, it will create an endless loop. that is
+    // why we add a counter so we wake up the shreds only once.
+    ShredPtr shred;
+    int i = queue.size();
+    Time now = Server::singleton->getNow();
+    while (!queue.empty() && i > 0) {
+        shred = queue.front();
+        queue.pop();
+        shred->next = now;
+        shred->run(args);
+        i--;
+    }
+}
+
+void Event::signal(object args)
+{
+    // if at least a shred is waiting for this event get the first shred from
+    // the queue and shredule it now
+
+    if (queue.empty()) {
+        return;
+    }
+
+    ShredPtr shred = queue.front();
+    queue.pop();
+    shred->next = Server::singleton->getNow();
+    shred->run(args);
+}
+
+// ShredList class
+///////////////////////////////////////////////////////////////////////////////
+
+void ShredList::append(ShredPtr shred)
+{
+    shred->following.reset();
+    if (last) {
+        last->following = shred;
+    } else {
+        first = shred;
+    }
+    last = shred.get();
+}
+
+ShredPtr ShredList::take()
+{
+    ShredPtr chain;
+    chain.swap(first);
+    last = NULL;
+    return chain;
+}
+
+Time ShredList::earliest()
+{
+    Time time = ShredWheel::never;
+    for (Shred *shred = first.get(); shred; shred = shred->following.get()) {
+        time = min(time, shred->next);
+    }
+    return time;
+}
+
+void ShredList::clear()
+{
+    // unlinked one by one, rather than by a chain of destructors
+    ShredPtr shred = take();
+    while (shred) {
+        ShredPtr following = shred->following;
+        shred->following.reset();
+        shred = following;
+    }
+}
+
+// ShredWheel class
+///////////////////////////////////////////////////////////////////////////////
+
+ShredWheel::ShredWheel()
+{
+    current = 0;
+    count = 0;
+    wake = never;
+    for (int k=0; k<levels; k++) {
+        for (int w=0; w<slots/64; w++) {
+            occupied[k][w] = 0;
+        }
+    }
+}
+
+ShredWheel::~ShredWheel()
+{
+    clear();
+}
+
+bool ShredWheel::empty()
+{
+    return count == 0;
+}
+
+int ShredWheel::size()
+{
+    return count;
+}
+
+void ShredWheel::clear()
+{
+    for (int k=0; k<levels; k++) {
+        for (int i=0; i<slots; i++) {
+            wheel[k][i].clear();
+        }
+        for (int w=0; w<slots/64; w++) {
+            occupied[k][w] = 0;
+        }
+    }
+    overflow.clear();
+    late.clear();
+    count = 0;
+    wake = never;
+}
+
+void ShredWheel::push(ShredPtr shred)
+{
+    Time time = shred->next;
+    count++;
+    if (time < wake) {
+        wake = time;
+    }
+
+    if (time < current) {
+        late.append(shred);
+        return;
+    }
+
+    // the level of the highest byte differing from the current time
+    boost::uint64_t diff = (boost::uint64_t) time ^ current;
+    int k = 0;
+    while (k < levels && (diff >> (8*(k+1))) != 0) {
+        k++;
+    }
+    if (k == levels) {
+        overflow.append(shred);
+        return;
+    }
+
+    int i = (time >> (8*k)) & (slots-1);
+    wheel[k][i].append(shred);
+    occupied[k][i/64] |= (boost::uint64_t) 1 << (i%64);
+}
+
+ShredPtr ShredWheel::pop(Time until)
+{
+    // remove the shreds due first, if not after until. the ones pushed
+    // behind the current time come first, as they are all due before the
+    // shreds left in the wheel.
+    Time time = next(until);
+    if (time == never || until < time) {
+        wake = time;
+        return ShredPtr();
+    }
+
+    ShredPtr due;
+    if (!late.empty()) {
+        ShredList found;
+        ShredPtr shred = late.take();
+        while (shred) {
+            ShredPtr following = shred->following;
+            if (shred->next == time) {
+                found.append(shred);
+                count--;
+            } else {
+                late.append(shred);
+            }
+            shred = following;
+        }
+        due = found.take();
+    } else {
+        // next() leaves the shreds due first in the lowest level
+        int i = time & (slots-1);
+        due = wheel[0][i].take();
+        for (Shred *shred = due.get(); shred; shred = shred->following.get()) {
+            count--;
+        }
+        occupied[0][i/64] &= ~((boost::uint64_t) 1 << (i%64));
+        moveTo(time + 1);
+    }
+    wake = next(until);
+    return due;
+}
+
+Time ShredWheel::next(Time until)
+{
+    if (!late.empty()) {
+        return late.earliest();
+    }
+
+    while (count) {
+        int i = findSlot(0, current & (slots-1));
+        if (i >= 0) {
+            return (current & ~(Time) (slots-1)) | i;
+        }
+
+        // the next occupied slot of a higher level, or the overflow
+        Time start = never;
+        for (int k=1; k<levels && start == never; k++) {
+            int j = findSlot(k, ((current >> (8*k)) & (slots-1)) + 1);
+            if (j >= 0) {
+                boost::uint64_t window = (boost::uint64_t) current >> (8*(k+1)) << (8*(k+1));
+                start = window | ((boost::uint64_t) j << (8*k));
+            }
+        }
+        if (start == never) {
+            start = overflow.earliest();
+        }
+
+        // the current time never goes past until: shreds pushed later on for
+        // a time in between still find their slot rather than the late list
+        if (until < start) {
+            return start;
+        }
+        moveTo(start);
+    }
+    return never;
+}
+
+// push again the shreds of a chain, once the current time moved
+static void repush(ShredWheel& wheel, ShredPtr shred)
+{
+    while (shred) {
+        ShredPtr following = shred->following;
+        wheel.count--;
+        wheel.push(shred);
+        shred = following;
+    }
+}
+
+void ShredWheel::moveTo(Time time)
 {
-    // wake up all shreds that are waiting for this event. if a shred finish by
-    // waiting for this event again, it will create an endless loop. that is
-    // why we add a counter so we wake up the shreds only once.
-    ShredPtr shred;
-    int i = queue.size();
-    while (!queue.empty() && i > 0) {
-        shred = queue.front();
-        queue.pop();
-        shred->run(args);
-        i--;
+    // no shred is due between the current time and the new one, so the
+    // slots entered by the current time are the only ones to move down
+    Time previous = current;
+    current = time;
+
+    if (((boost::uint64_t) previous >> (8*levels)) != ((boost::uint64_t) time >> (8*levels))) {
+        repush(*this, overflow.take());
+    }
+    for (int k=levels-1; k>0; k--) {
+        if ((previous >> (8*k)) != (time >> (8*k))) {
+            cascade(k, (time >> (8*k)) & (slots-1));
+        }
     }
 }
 
-void Event::signal(object args)
+void ShredWheel::cascade(int level, int slot)
 {
-    // if at least a shred is waiting for this event get the first shred from
-    // the queue and shredule it now
-
-    if (queue.empty()) {
+    if (wheel[level][slot].empty()) {
         return;
     }
 
-    ShredPtr shred = queue.front();
-    queue.pop();
-    shred->run(args);
-}
-
-bool UGenComparator::operator()(weak_ptr<UGen> const& lhs, weak_ptr<UGen> const& rhs) {
-    UGenPtr shared_lhs = lhs.lock();
-    UGenPtr shared_rhs = rhs.lock();
-    return shared_lhs.get() < shared_rhs.get();
+    occupied[level][slot/64] &= ~((boost::uint64_t) 1 << (slot%64));
+    repush(*this, wheel[level][slot].take());
 }
 
-bool ShredComparator::operator()(ShredPtr const& lhs, ShredPtr const& rhs) {
-    return lhs->next > rhs->next;
+int ShredWheel::findSlot(int level, int from)
+{
+    // first occupied slot at or after from, or -1
+    for (int w=from/64; w<slots/64; w++) {
+        boost::uint64_t bits = occupied[level][w];
+        if (w == from/64) {
+            bits &= ~(boost::uint64_t) 0 << (from%64);
+        }
+        if (bits) {
+            return w*64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
 }
 
 // Server class
@@ -365,7 +1933,7 @@ bool ShredComparator::operator()(ShredPtr const& lhs, ShredPtr const& rhs) {
 
 ServerPtr Server::singleton = ServerPtr();
 
-Server::Server(int channels)
+Server::Server(int channels) : shredTime(&Server::keepTime)
 {
     // check if there is at least one audio interface available
     if (audio.getDeviceCount() == 0) {
@@ -376,26 +1944,73 @@ Server::Server(int channels)
     info = audio.getDeviceInfo(device);
 
     inputParams.deviceId = device;
-    inputParams.nChannels = channels;
     outputParams.deviceId = device;
-    outputParams.nChannels = channels;
-
-    bufferFrames = 256;
 
-    this->now = 0;
+    bufferFrames = defaultBufferFrames;
+    offline = false;
     this->srate = info.sampleRates[0];
-    this->io = UGenPtr(new UGen(channels,channels));
+    setup(channels);
+
+    // planar buffers are handed to io as they are. RtAudio converts them
+    // for the backends that only deal with interleaved ones.
+    RtAudio::StreamOptions options;
+    options.flags = RTAUDIO_NONINTERLEAVED;
+    RtAudioFormat format = sizeof(Sample) == sizeof(float) ? RTAUDIO_FLOAT32 : RTAUDIO_FLOAT64;
+    audio.openStream(&outputParams, &inputParams, format, srate, 
+            &bufferFrames, &callback, NULL, &options);
+
+    // the backend may have picked another buffer size
+    io->allocate(bufferFrames);
+    ioInput = io->input;
+    ioOutput = io->output;
+}
+
+Server::Server(int channels, Samplerate srate, unsigned int bufferFrames) :
+    shredTime(&Server::keepTime)
+{
+    this->bufferFrames = bufferFrames;
+    offline = true;
+    this->srate = srate;
+    setup(channels);
+}
+
+void Server::setup(int channels)
+{
+    inputParams.nChannels = channels;
+    outputParams.nChannels = channels;
 
-    audio.openStream(&outputParams, &inputParams, RTAUDIO_FLOAT32, srate, 
-            &bufferFrames, &callback, NULL, NULL);
+    this->clock = 0;
+    this->lookahead = 0;
+    this->shreduling = false;
+    this->reclaiming = false;
+    this->io = UGenPtr(new UGen(channels,channels));
+    io->allocate(bufferFrames);
+    ioInput = io->input;
+    ioOutput = io->output;
+
+    running = false;
+    pending = 0;
+    held = 0;
+    dispatched = 0;
+    dropped = 0;
+    waiting.reserve(commandCapacity);
+    touched.reserve(commandCapacity);
+    schedule = NULL;
+    published = NULL;
+    upcoming = NULL;
+    retired = NULL;
+    dirty = false;
+    compile();
 }
 
 Server::~Server()
 {
     stop();
+    pool.stop();
     if (audio.isStreamOpen()) {
         audio.closeStream();
     }
+    delete schedule;
 }
 
 ServerPtr Server::open(int channels)
@@ -409,14 +2024,76 @@ ServerPtr Server::open(int channels)
     return Server::singleton;
 }
 
+ServerPtr Server::openOffline(int channels, Samplerate srate, unsigned int bufferFrames)
+{
+    if (Server::singleton) {
+        // FIXME throw exception server started
+        cerr << "server already started" << endl;
+    } else {
+        Server::singleton = ServerPtr(new Server(channels, srate, bufferFrames));
+    }
+    return Server::singleton;
+}
+
 void Server::start()
 {
+    if (offline) {
+        // FIXME throw exception "offline server"
+        cerr << "offline server, use render()" << endl;
+        return;
+    }
+
+#if PY_MAJOR_VERSION < 3
+    PyEval_InitThreads();
+#endif
+    if (dirty) {
+        compile();
+    }
+    running = true;
+
+    reclaiming = true;
+    reclaimer = boost::thread(&Server::reclaim, this);
+
+    if (lookahead) {
+        shreduling = true;
+        shreduler = boost::thread(&Server::shredule, this);
+    }
+
     audio.startStream();
 }
 
 void Server::stop()
 {
-    audio.stopStream();
+    // the audio thread may be waiting for the GIL
+    if (audio.isStreamRunning()) {
+        Py_BEGIN_ALLOW_THREADS
+        audio.stopStream();
+        Py_END_ALLOW_THREADS
+    }
+    io->input = ioInput;
+    io->output = ioOutput;
+
+    if (shreduler.joinable()) {
+        shreduling = false;
+        // the shreduler needs the GIL to finish its round
+        Py_BEGIN_ALLOW_THREADS
+        shreduler.join();
+        Py_END_ALLOW_THREADS
+    }
+
+    if (reclaimer.joinable()) {
+        reclaiming = false;
+        reclaimWake.notify_one();
+        Py_BEGIN_ALLOW_THREADS
+        reclaimer.join();
+        Py_END_ALLOW_THREADS
+    }
+    running = false;
+
+    // the audio thread is gone, apply what it left behind
+    drain((Time) -1);
+    adopt((Time) -1);
+    collect();
 }
 
 void Server::close()
@@ -430,24 +2107,346 @@ void Server::close()
     }
 }
 
-void Server::tick()
+void Server::post(Command *command)
+{
+    ServerPtr s = Server::singleton;
+
+    // nothing is running concurrently, apply right away
+    if (!s || !s->running) {
+        command->apply();
+        delete command;
+        return;
+    }
+
+    command->time = s->stamp();
+    if (!s->commands.push(command)) {
+        // queue is full, never block the caller
+        s->dropped++;
+        delete command;
+    }
+
+    // wake the reclaim thread up early when the return queue fills up
+    if (s->pending > commandCapacity / 2) {
+        s->reclaimWake.notify_one();
+    }
+}
+
+void Server::invalidate()
+{
+    // the schedule is compiled again once for a burst of changes: when the
+    // shred making them yields, by the reclaim thread, or before processing
+    // when the server is not running
+    ServerPtr s = Server::singleton;
+    if (s) {
+        s->dirty = true;
+        if (s->running && !s->inShred()) {
+            s->reclaimWake.notify_one();
+        }
+    }
+}
+
+// the shred times live in their ShredContext
+void Server::keepTime(Time *time)
+{}
+
+bool Server::inShred()
+{
+    return shredTime.get() != 0;
+}
+
+Time Server::stamp()
+{
+    // commands sent from a shred running ahead of the audio clock happen at
+    // the shred's logical time. anything else happens as soon as possible.
+    if (lookahead && inShred()) {
+        return *shredTime;
+    }
+    return 0;
+}
+
+void Server::compile()
+{
+    dirty = false;
+    Schedule *next = new Schedule();
+    next->compile(io, bufferFrames);
+    next->time = stamp();
+    latest = next;
+
+    if (running) {
+        Schedule *head = published.load();
+        do {
+            next->next = head;
+        } while (!published.compare_exchange_weak(head, next));
+    } else {
+        std::swap(schedule, next);
+        delete next;
+    }
+}
+
+void Server::drain(Time until)
+{
+    // audio side: receive commands, keeping them sorted by time. they
+    // usually arrive in order, so the insertion point is found quickly.
+    // everything received or applied but not collected fits in the return
+    // queue.
+    Command *command;
+    while (held + pending < commandCapacity && commands.pop(command)) {
+        vector<Command*>::iterator it = waiting.end();
+        while (it != waiting.begin() && command->time < (*(it-1))->time) {
+            --it;
+        }
+        waiting.insert(it, command);
+        held++;
+    }
+
+    // apply the ones that are due
+    size_t i = 0;
+    while (i < waiting.size() && waiting[i]->time <= until) {
+        waiting[i]->apply();
+        retire(waiting[i]);
+        i++;
+    }
+    waiting.erase(waiting.begin(), waiting.begin() + i);
+}
+
+int Server::dispatch(int frames)
+{
+    // a command without target splits the whole graph: the block is cut
+    // right before it. the commands due before that only concern one ugen,
+    // which will split its own processing.
+    size_t i = 0;
+    while (i < waiting.size() && waiting[i]->time < clock + frames) {
+        if (!waiting[i]->target()) {
+            frames = waiting[i]->time - clock;
+            break;
+        }
+        UGen *target = waiting[i]->target();
+        if (!target->queued) {
+            touched.push_back(target);
+        }
+        target->queue(waiting[i]);
+        i++;
+    }
+
+    // they stay in the waiting list until settle(), as ugens may run on
+    // other threads and cannot hand them back themselves
+    dispatched = i;
+    return frames;
+}
+
+void Server::settle()
+{
+    // ugens outside of the graph did not apply their commands
+    for (size_t i=0; i<touched.size(); i++) {
+        UGen *ugen = touched[i];
+        while (ugen->queued) {
+            Command *command = ugen->queued;
+            ugen->queued = command->next;
+            command->apply();
+        }
+        ugen->lastQueued = NULL;
+    }
+    touched.clear();
+
+    for (size_t i=0; i<dispatched; i++) {
+        retire(waiting[i]);
+    }
+    waiting.erase(waiting.begin(), waiting.begin() + dispatched);
+    dispatched = 0;
+}
+
+void Server::retire(Command *command)
+{
+    // hand a command back for deletion
+    applied.push(command);
+    pending++;
+    held--;
+}
+
+void Server::adopt(Time until)
+{
+    // audio side: take the schedules published since last time, and switch
+    // to the ones due, in publication order
+    if (published.load()) {
+        Schedule *list = published.exchange(NULL);
+        Schedule *ordered = NULL;
+        while (list) {
+            Schedule *next = list->next;
+            list->next = ordered;
+            ordered = list;
+            list = next;
+        }
+        Schedule **tail = &upcoming;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        *tail = ordered;
+    }
+
+    while (upcoming && upcoming->time <= until) {
+        Schedule *next = upcoming;
+        upcoming = next->next;
+        retire(schedule);
+        schedule = next;
+    }
+}
+
+void Server::retire(Schedule *schedule)
 {
-    // shreduling
-    if (!queue.empty()){
-        gstate = PyGILState_Ensure();
-        while (!queue.empty() && queue.top()->next <= now ) {
-            queue.top()->run();
-            queue.pop();
+    // push on the retired list, taken as a whole by collect()
+    Schedule *head = retired.load();
+    do {
+        schedule->next = head;
+    } while (!retired.compare_exchange_weak(head, schedule));
+}
+
+void Server::collect()
+{
+    // control side: delete the commands applied by the audio thread
+    boost::lock_guard<boost::mutex> lock(collecting);
+    Command *command;
+    while (applied.pop(command)) {
+        delete command;
+        pending--;
+    }
+
+    Schedule *old = retired.exchange(NULL);
+    while (old) {
+        Schedule *next = old->next;
+        delete old;
+        old = next;
+    }
+
+    if (latest->release()) {
+        dirty = true;
+    }
+    if (dirty) {
+        compile();
+    }
+}
+
+void Server::reclaim()
+{
+    // commands may hold the last reference to python objects, so they are
+    // deleted with the GIL held
+    while (reclaiming) {
+        {
+            boost::unique_lock<boost::mutex> lock(reclaimMutex);
+            reclaimWake.timed_wait(lock, boost::posix_time::milliseconds(10));
+        }
+        PyGILState_STATE state = PyGILState_Ensure();
+        collect();
+        PyGILState_Release(state);
+    }
+}
+
+// run a chain of shreds popped from the wheel. each one is unlinked first,
+// as it may be pushed back while it runs. returns how many ran.
+static unsigned long runShreds(ShredPtr shred)
+{
+    unsigned long count = 0;
+    while (shred) {
+        ShredPtr following = shred->following;
+        shred->following.reset();
+        shred->run();
+        shred = following;
+        count++;
+    }
+    return count;
+}
+
+void Server::process(int frames)
+{
+    // the blocks of every scheduled node hold bufferFrames frames
+    assert(frames <= (int) bufferFrames);
+
+    // called from python rather than from the audio thread
+    if (!running) {
+        collect();
+    }
+
+    int offset = 0;
+    unsigned long resumed = 0;
+    while (offset < frames) {
+        adopt(clock);
+        drain(clock);
+
+        // shreduling, unless shreds have their own thread. shreds can
+        // reschedule themselves at the current time through the command
+        // queue, so drain it again before going on.
+        // the GIL is only taken when a shred is due.
+        if (!lookahead && queue.wake <= clock) {
+            gstate = metrics.ensure();
+            resumed += runShreds(queue.pop(clock));
+            PyGILState_Release(gstate);
+            continue;
+        }
+
+        // sound synthesis, up to the next shred wake up or timestamped
+        // command so that both stay sample accurate
+        int n = frames - offset;
+        if (!lookahead && queue.wake < clock + n) {
+            n = queue.wake - clock;
+        }
+        if (upcoming && upcoming->time < clock + n) {
+            n = upcoming->time - clock;
+        }
+        n = dispatch(n);
+        schedule->run(clock, offset, n);
+        settle();
+
+        clock += n;
+        offset += n;
+    }
+
+    metrics.blocks.add(1);
+    if (resumed) {
+        metrics.shreds.add(resumed);
+        metrics.mostShreds.raise(resumed);
+    }
+}
+
+void Server::shredule()
+{
+    // never sleep more than half a buffer, in microseconds
+    long period = 500000L * bufferFrames / srate;
+
+    while (shreduling) {
+        Time horizon = clock + lookahead;
+        long wait = period;
+
+        // nothing due: no need for the GIL
+        if (queue.wake <= horizon) {
+            PyGILState_STATE state = PyGILState_Ensure();
+            unsigned long resumed = 0;
+            while (queue.wake <= horizon) {
+                resumed += runShreds(queue.pop(horizon));
+            }
+            metrics.shreds.add(resumed);
+            metrics.mostShreds.raise(resumed);
+            PyGILState_Release(state);
         }
-        PyGILState_Release(gstate);
+
+        Time wake = queue.wake;
+        if (wake != ShredWheel::never && horizon < wake) {
+            wait = min(wait, (long) ((wake - horizon) * 1000000 / srate));
+        }
+
+        boost::this_thread::sleep(boost::posix_time::microseconds(wait));
     }
-    // sound synthesis
-    io->tick();
-    now++;
 }
 
 ShredPtr Server::spork(boost::python::object gen)
 {
+    // native shreds come ready made, python ones wrap a generator
+    extract<NativeShredPtr> native(gen);
+    if (native.check()) {
+        ShredPtr shred = native();
+        shred->next = getNow();
+        addShred(shred);
+        return shred;
+    }
+
     ShredPtr shred(new Shred(gen));
     addShred(shred);
     return shred;
@@ -455,12 +2454,36 @@ ShredPtr Server::spork(boost::python::object gen)
 
 void Server::addShred(ShredPtr shred)
 {
-    queue.push(shred);
+    if (lookahead) {
+        // the queue belongs to the shreduler thread, and is only used with
+        // the GIL held
+        queue.push(shred);
+    } else {
+        post(new ShredCommand(shred));
+    }
 }
 
 Time Server::getNow() 
 { 
-    return now; 
+    if (inShred()) {
+        return *shredTime;
+    }
+    return clock;
+}
+
+Duration Server::getLookahead()
+{
+    return lookahead;
+}
+
+void Server::setLookahead(Duration lookahead)
+{
+    if (running) {
+        // FIXME throw exception "server running"
+        cerr << "cannot change lookahead while running" << endl;
+    } else {
+        this->lookahead = lookahead;
+    }
 }
 
 Samplerate Server::getSrate() 
@@ -468,37 +2491,226 @@ Samplerate Server::getSrate()
     return srate; 
 }
 
+unsigned long Server::getDropped()
+{
+    return dropped;
+}
+
+int Server::getWorkers()
+{
+    return pool.size();
+}
+
+void Server::setWorkers(int workers)
+{
+    if (running) {
+        // FIXME throw exception "server running"
+        cerr << "cannot change the number of workers while running" << endl;
+        return;
+    }
+    pool.stop();
+    if (workers > 0) {
+        pool.start(workers);
+    }
+}
+
 UGenPtr Server::getIO()
 { 
     return io;
 }
 
+dict Server::getMetrics()
+{
+    dict d;
+    boost::python::list histogram;
+    for (int b=0; b<Metrics::buckets; b++) {
+        histogram.append(metrics.histogram[b].get());
+    }
+    d["callbacks"] = metrics.callbacks.get();
+    d["histogram"] = histogram;
+    d["deadline"] = bufferFrames * 1000000000UL / srate;
+    d["late"] = metrics.histogram[Metrics::buckets-1].get();
+    d["busy"] = metrics.busy.get();
+    d["worst"] = metrics.worst.get();
+    d["underflows"] = metrics.underflows.get();
+    d["overflows"] = metrics.overflows.get();
+    d["gilWait"] = metrics.gilWait.get();
+    d["gilTaken"] = metrics.gilTaken.get();
+    d["blocks"] = metrics.blocks.get();
+    d["shreds"] = metrics.shreds.get();
+    d["mostShreds"] = metrics.mostShreds.get();
+    d["dropped"] = getDropped();
+    return d;
+}
 
-int callback(void *outputBuffer, void *inputBuffer, unsigned int bufferFrames,
-        double streamTime, RtAudioStreamStatus status, void *userData )
+void Server::resetMetrics()
 {
-    ServerPtr server = Server::singleton;
+    metrics.reset();
+    for (size_t i=0; i<latest->nodes.size(); i++) {
+        latest->nodes[i]->cpu.set(0);
+    }
+}
 
-    // points to one value inside the inputBuffer
-    Sample *input = (Sample *) inputBuffer;
-    Sample *output = (Sample *) outputBuffer;
+bool Server::getProfiling()
+{
+    return metrics.profiling;
+}
 
-    for (int i=0; i<bufferFrames; i++) {
+void Server::setProfiling(bool profiling)
+{
+    metrics.profiling = profiling;
+}
 
-        // copy values from inputBuffer to io.output	
-        for (int j=0; j<server->inputParams.nChannels; j++) {
-            server->io->output[j] = *input++;
-        }
+dict Server::profile()
+{
+    // time spent by the nodes of the graph, summed by class
+    dict d;
+    for (size_t i=0; i<latest->nodes.size(); i++) {
+        UGen *ugen = latest->nodes[i];
+        int status;
+        char *name = abi::__cxa_demangle(typeid(*ugen).name(), NULL, NULL, &status);
+        object key = str(status == 0 ? name : typeid(*ugen).name());
+        free(name);
+        d[key] = extract<unsigned long>(d.get(key, 0))() + ugen->cpu.get();
+    }
+    return d;
+}
 
-        // calling pyck's ugen processing
-        server->tick();
+void Server::cycle(Sample const *input, Sample *output, unsigned int frames)
+{
+    unsigned long start = Metrics::nanoseconds();
 
-        // retrieving results
-        for (int j=0; j<server->outputParams.nChannels; j++) {
-            *output++ = server->io->input[j];
-        }
+    // copy values from the interleaved input to io.output, or silence
+    if (input) {
+        deinterleave(io->output.get(), input, inputParams.nChannels, io->blockSize, frames);
+    } else {
+        io->resetOutput(0, frames);
+    }
+
+    // calling pyck's ugen processing on the whole buffer
+    process(frames);
+
+    // retrieving results
+    interleave(output, io->input.get(), outputParams.nChannels, io->blockSize, frames);
+
+    metrics.cycle(Metrics::nanoseconds() - start, frames * 1000000000UL / srate);
+}
+
+void Server::cyclePlanar(Sample *input, Sample *output, unsigned int frames)
+{
+    unsigned long start = Metrics::nanoseconds();
+
+    // RtAudio always asks for the buffer size io was allocated with, so the
+    // device buffers are laid out like the io blocks: io reads and writes
+    // them in place. binding shares the ownership of io's own blocks, so
+    // nothing is allocated or freed here.
+    if (!input) {
+        io->resetOutput(0, frames);
+    } else if (io->output.get() != input) {
+        io->output = boost::shared_array<Sample>(ioOutput, input);
+    }
+    if (io->input.get() != output) {
+        io->input = boost::shared_array<Sample>(ioInput, output);
+    }
+
+    process(frames);
+
+    metrics.cycle(Metrics::nanoseconds() - start, frames * 1000000000UL / srate);
+}
+
+void Server::render(Sample *output, Duration frames)
+{
+    if (running) {
+        // FIXME throw exception "server running"
+        cerr << "server running, stop it before rendering" << endl;
+        return;
+    }
+
+    // shreds run inline, between blocks, as in callback mode
+    while (frames) {
+        unsigned int n = std::min(frames, (Duration) bufferFrames);
+        cycle(NULL, output, n);
+        output += n * outputParams.nChannels;
+        frames -= n;
+    }
+}
+
+object Server::renderBuffer(Duration frames)
+{
+    // interleaved samples
+    Py_ssize_t size = frames * outputParams.nChannels * sizeof(Sample);
+    object buffer(handle<>(PyByteArray_FromStringAndSize(NULL, size)));
+    render((Sample *) PyByteArray_AsString(buffer.ptr()), frames);
+    return buffer;
+}
+
+static void writeWord(FILE *file, unsigned long value, int bytes)
+{
+    // little endian, whatever the host
+    for (int i=0; i<bytes; i++) {
+        fputc((value >> (8*i)) & 0xff, file);
+    }
+}
+
+void Server::renderFile(string filename, Duration frames)
+{
+    // the sizes in a WAV header are 32 bits long
+    unsigned int channels = outputParams.nChannels;
+    bool raw = filename.size() >= 4 && filename.substr(filename.size() - 4) == ".raw";
+    unsigned long frameBytes = channels * sizeof(Sample);
+    if (!raw && frameBytes && frames > (0xffffffffUL - 36) / frameBytes) {
+        PyErr_SetString(PyExc_ValueError, "too long for a WAV file, render to a .raw file");
+        throw_error_already_set();
+    }
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        // FIXME throw exception "cannot open file"
+        cerr << "cannot open " << filename << endl;
+        return;
+    }
+
+    // anything but .raw gets an IEEE float WAV header
+    if (!raw) {
+        unsigned long bytes = frames * frameBytes;
+        fwrite("RIFF", 1, 4, file);
+        writeWord(file, 36 + bytes, 4);
+        fwrite("WAVEfmt ", 1, 8, file);
+        writeWord(file, 16, 4);
+        writeWord(file, 3, 2); // WAVE_FORMAT_IEEE_FLOAT
+        writeWord(file, channels, 2);
+        writeWord(file, srate, 4);
+        writeWord(file, srate * channels * sizeof(Sample), 4);
+        writeWord(file, channels * sizeof(Sample), 2);
+        writeWord(file, 8 * sizeof(Sample), 2);
+        fwrite("data", 1, 4, file);
+        writeWord(file, bytes, 4);
     }
 
+    // samples are written as they are, which is little endian on any
+    // platform we care about
+    vector<Sample> buffer(bufferFrames * channels);
+    while (frames && !running) {
+        unsigned int n = std::min(frames, (Duration) bufferFrames);
+        render(&buffer[0], n);
+        fwrite(&buffer[0], sizeof(Sample), n * channels, file);
+        frames -= n;
+    }
+    fclose(file);
+}
+
+
+int callback(void *outputBuffer, void *inputBuffer, unsigned int bufferFrames,
+        double streamTime, RtAudioStreamStatus status, void *userData )
+{
+    Server *s = Server::singleton.get();
+    if (status & RTAUDIO_OUTPUT_UNDERFLOW) {
+        s->metrics.underflows.add(1);
+    }
+    if (status & RTAUDIO_INPUT_OVERFLOW) {
+        s->metrics.overflows.add(1);
+    }
+    s->cyclePlanar((Sample *) inputBuffer, (Sample *) outputBuffer, bufferFrames);
     return 0;
 }
 
@@ -541,40 +2753,92 @@ BOOST_PYTHON_MODULE(libcore)
         .def(init<UGenPtr>())
         .def_readonly("inputSize",&UGen::inputSize)  
         .def_readonly("outputSize",&UGen::outputSize)
+        .def_readonly("blockSize",&UGen::blockSize)
+        .add_property("silent",&UGen::getSilent)
+        .add_property("cpu",&UGen::getCpu)
+        .add_property("inputs",&UGen::getInputs)
+        .add_property("outputs",&UGen::getOutputs)
         .def("input",&UGen::getInput)
         .def("setInput",&UGen::setInput)
         .def("output",&UGen::getOutput)
         .def("setOutput",&UGen::setOutput)
         .def("addSource",&UGen::addSource)
         .def("addSource",&UGen::addSourceRoute)
-        .def("removeSource",&UGen::removeSource)
-        .def("tick", &UGen::tick)
-        .def("fetch",&UGen::fetch)
-        .def("compute",&UGen::compute);
+        .def("removeSource",&UGen::removeSource);
+
+    readyBlockView();
+
+    class_<PythonUGen, bases<UGen>, PythonUGenPtr, boost::noncopyable>("PythonUGen", init<int,int>());
 
     class_<Route, RoutePtr>("Route", init<int, int>())
         .def(init<UGenPtr, UGenPtr>())
-        .def(init<list>())    
+        .def(init<boost::python::list>())    
         .def_readonly("sourceSize", &Route::sourceSize)
-        .def_readonly("targetSize", &Route::targetSize);
+        .def_readonly("targetSize", &Route::targetSize)
+        .def("gain", &Route::getGain)
+        .def("setGain", &Route::setGain);
+
+    class_<ParamRef>("Param", no_init)
+        .add_property("value", &ParamRef::getValue)
+        .add_property("target", &ParamRef::getTarget)
+        .add_property("moving", &ParamRef::moving)
+        .def("rampTo", &ParamRef::rampTo)
+        .def("expTo", &ParamRef::expTo)
+        .def("smooth", &ParamRef::smooth)
+        .def("__float__", &ParamRef::getValue)
+        .def("__add__", &paramAdd)
+        .def("__radd__", &paramAdd)
+        .def("__sub__", &paramSub)
+        .def("__rsub__", &paramRsub)
+        .def("__mul__", &paramMul)
+        .def("__rmul__", &paramMul)
+        .def("__div__", &paramDiv)
+        .def("__truediv__", &paramDiv)
+        .def("__rdiv__", &paramRdiv)
+        .def("__rtruediv__", &paramRdiv)
+        .def("__eq__", &paramEq)
+        .def("__ne__", &paramNe)
+        .def("__lt__", &paramLt)
+        .def("__le__", &paramLe)
+        .def("__gt__", &paramGt)
+        .def("__ge__", &paramGe)
+        .def("__repr__", &paramRepr);
+    implicitly_convertible<ParamRef, float>();
 
     class_<Shred, ShredPtr>("Shred", no_init)
         .def_readonly("next",&Shred::next)
         .def("kill",&Shred::kill);
 
+    class_<NativeShred, bases<Shred>, NativeShredPtr, boost::noncopyable>("NativeShred", no_init)
+        .add_property("done", &NativeShred::isDone);
+
     class_<Event, EventPtr>("Event")
         .def("signal",&Event::signal)
         .def("broadcast",&Event::broadcast);
 
-    class_<Server, ServerPtr>("Server", no_init)
+    class_<Server, ServerPtr, boost::noncopyable>("Server", no_init)
         .def("open",&Server::open).staticmethod("open")
+        .def("openOffline",&Server::openOffline,
+            (boost::python::arg("channels"),
+             boost::python::arg("srate")=44100,
+             boost::python::arg("bufferFrames")=(unsigned int) Server::defaultBufferFrames))
+        .staticmethod("openOffline")
         .def("start",&Server::start)
         .def("stop",&Server::stop)	
         .def("close",&Server::close)
         .def("spork",&Server::spork)
-        .def("tick",&Server::tick)
+        .def("render",&Server::renderBuffer)
+        .def("renderFile",&Server::renderFile)
+        .def_readonly("bufferFrames",&Server::bufferFrames)
         .add_property("now",&Server::getNow)
+        .add_property("lookahead",&Server::getLookahead,&Server::setLookahead)
         .add_property("srate",&Server::getSrate)
+        .add_property("dropped",&Server::getDropped)
+        .add_property("workers",&Server::getWorkers,&Server::setWorkers)
+        .add_property("metrics",&Server::getMetrics)
+        .add_property("profiling",&Server::getProfiling,&Server::setProfiling)
+        .def("resetMetrics",&Server::resetMetrics)
+        .def("profile",&Server::profile)
         .add_property("dac",&Server::getIO)
         .add_property("adc",&Server::getIO);
 
@@ -583,4 +2847,5 @@ BOOST_PYTHON_MODULE(libcore)
     def("minute",&minute);
     def("hour",&hour);
     def("day",&day);
+    def("simd",&simdName);
 }
@@ -12,113 +12,561 @@
 #include <boost/shared_array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/thread.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/asio/coroutine.hpp>
 
 #include <rtaudio/RtAudio.h>
 
 // structs
 struct UGen;
+struct PythonUGen;
 struct Route;
 struct Server;
 struct Shred;
+struct NativeShred;
 struct Event;
+struct Source;
+struct Edge;
+struct Schedule;
+struct Param;
+struct ParamRef;
+struct Command;
 
-struct UGenComparator;
-struct ShredComparator;
+struct ShredList;
+struct ShredWheel;
 
 // shared pointers
 typedef boost::shared_ptr<UGen> UGenPtr;
+typedef boost::shared_ptr<PythonUGen> PythonUGenPtr;
 typedef boost::shared_ptr<Route> RoutePtr;
 typedef boost::shared_ptr<Server> ServerPtr;
 typedef boost::shared_ptr<Shred> ShredPtr;
+typedef boost::shared_ptr<NativeShred> NativeShredPtr;
 typedef boost::shared_ptr<Event> EventPtr;
 
 // simple aliases
 typedef unsigned long int Time;
 typedef unsigned long int Duration;
+// samples are single precision unless built with PYCK_DOUBLE
+#ifdef PYCK_DOUBLE
+typedef double Sample;
+#else
 typedef float Sample;
+#endif
 typedef unsigned long int Samplerate;
 
 // templatefull aliases
-typedef std::map< boost::weak_ptr<UGen>, RoutePtr, UGenComparator > SourceList;
-typedef std::priority_queue<ShredPtr, std::vector<ShredPtr>, ShredComparator> ShredQueue;
+typedef std::vector<Source> SourceList;
+
+// control -> audio thread, and back once applied so that commands are always
+// deleted outside of the audio thread
+static const int commandCapacity = 4096;
+typedef boost::lockfree::queue< Command*, boost::lockfree::capacity<commandCapacity> > CommandQueue;
+typedef boost::lockfree::spsc_queue< Command*, boost::lockfree::capacity<commandCapacity> > CommandReturn;
 
 // structs complete declarations
-struct UGenComparator
+// preallocated memory for sample buffers and small objects, carved in
+// blocks of power of two sizes aligned for SIMD. freed blocks go back to the
+// free list of their size, so once warmed up the engine stops going back to
+// malloc(). only used on the control side and by the reclaim thread.
+struct Arena
 {
-    bool operator()(boost::weak_ptr<UGen> const& lhs, boost::weak_ptr<UGen> const& rhs);
+    static const size_t slabSize = 1 << 20;
+    static const size_t alignment = 32;
+    static const int classes = 48;
+
+    boost::mutex mutex;
+    std::vector<char*> slabs;
+    char *cursor; // free space in the current slab
+    size_t left;
+    void *freeList[classes]; // blocks are chained through their first word
+
+    Arena();
+
+    static Arena& instance();
+    // both throw std::bad_alloc for blocks too big to be carved
+    static int sizeClass(size_t bytes);
+    static size_t product(int n, int m); // n*m samples, n and m not negative
+    void *allocate(size_t bytes);
+    void release(void *block, size_t bytes);
+
+    // a shared_array of samples handing its block back when released
+    static boost::shared_array<Sample> samples(size_t count);
 };
 
-struct ShredComparator
+struct ArenaDeleter
 {
-    bool operator()(ShredPtr const& lhs, ShredPtr const& rhs);
+    size_t bytes;
+
+    ArenaDeleter(size_t bytes) : bytes(bytes) {}
+    void operator()(void *block) { Arena::instance().release(block, bytes); }
+};
+
+// a counter written by one thread at a time and read by any, without locks.
+// copyable, so that structs holding one can be copied by boost::python.
+struct Counter
+{
+    boost::atomic<unsigned long> value;
+
+    Counter(unsigned long value = 0) : value(value) {}
+    Counter(Counter const& other) : value(other.get()) {}
+    Counter& operator=(Counter const& other) { set(other.get()); return *this; }
+
+    unsigned long get() const { return value.load(boost::memory_order_relaxed); }
+    void set(unsigned long n) { value.store(n, boost::memory_order_relaxed); }
+    void add(unsigned long n) { set(get() + n); }
+    void raise(unsigned long n) { if (n > get()) set(n); }
+};
+
+// a connection as seen from its target
+struct Source
+{
+    boost::weak_ptr<UGen> ugen;
+    RoutePtr route;
 };
 
 struct UGen: public boost::enable_shared_from_this<UGen>
 {
-    Time last;
-    
     int inputSize;
     int outputSize;
+    int blockSize; // number of frames stored per channel
+    int position; // end of the last processed range in the block
     
+    // planar blocks: channel c starts at c*blockSize
     boost::shared_array<Sample> input;
     boost::shared_array<Sample> output;
     
     SourceList sources;
 
+    // must run on the audio thread rather than on a worker of the pool
+    bool pinned;
+
+    // a delay: its output only depends on input stored a block ago or more.
+    // the schedule runs it before its sources and feeds it through store()
+    // once every node ran, which breaks the cycles going through it.
+    bool feedback;
+
+    // nanoseconds spent processing, counted while the server is profiling
+    Counter cpu;
+
+    // asleep: the schedule skips the node and its whole output block stays
+    // zero, until a command targets it or quiet() stops holding
+    bool silent;
+
+    // timestamped commands for this ugen falling inside the block being
+    // processed, in time order. only used by the audio thread.
+    Command *queued;
+    Command *lastQueued;
+
+    // a node only heard through its gate, like a part of a voice: it sleeps
+    // along with its inputs while gateOpen(gateIndex) does not hold on the
+    // gate, and no command is queued for either of them
+    UGen *gate;
+    int gateIndex;
+
     UGen();
     UGen(int inputs, int outputs);
     UGen(UGenPtr source);
     ~UGen();
-    
-    Time getLast();
+
+    // (re)allocate silent blocks. subclasses holding buffers sized after the
+    // block extend it.
+    virtual void allocate(int blockSize);
     
     Sample getInput(int channel);
     void setInput(int channel, Sample value);
-    void resetInput();
+    void resetInput(int offset, int frames);
     
     Sample getOutput(int channel);
     void setOutput(int channel, Sample value);
-    void resetOutput();
+    void resetOutput(int offset, int frames);
+
+    unsigned long getCpu();
+
+    // (channels, frames) views of the blocks, shared with python without
+    // copies
+    boost::python::object getInputs();
+    boost::python::object getOutputs();
+    static boost::python::object view(boost::shared_array<Sample> samples,
+            int channels, int blockSize, int offset, int frames);
     
     void addSource(UGenPtr source);
     void addSourceList(UGenPtr source, boost::python::list route);
     void addSourceRoute(UGenPtr source, RoutePtr route);
     
     void removeSource(UGenPtr source);
+    void forgetSource(UGen *source);
+    void pruneSources();
     
-    virtual void tick();
-    virtual void fetch();
-    virtual void compute();
+    // (re)initialize internal values whenever a parameter is changed.
+    virtual void init();
+
+    // whether process() would only produce zeros, given whether the mixed
+    // input is silent. quiet nodes sleep. never by default: ugens known to
+    // be stateless or drained override it.
+    virtual bool quiet(bool silentInput);
+
+    // whether the nodes gated by this one with the given index must run
+    virtual bool gateOpen(int index);
+
+    // called with the GIL held by the latest schedule: connect() when it
+    // takes the node, release() to tell whether owner, its entry, is the
+    // last reference left.
+    virtual void connect();
+    virtual bool release(UGenPtr& owner);
+    bool getSilent();
+
+    // process frames [offset, offset+frames) of the current block. tick()
+    // does not pull the sources: the server runs them in schedule order.
+    virtual void tick(int offset, int frames);
+    virtual void fetch(int offset, int frames);
+    virtual void process(int offset, int frames);
+
+    // keep the mixed input of frames [offset, offset+frames), for feedback
+    // nodes. called after every node of the schedule ran.
+    virtual void store(int offset, int frames, bool silentInput);
+
+    // process frames starting at the given time, splitting them wherever a
+    // queued command must be applied
+    void queue(Command *command);
+    void run(Time time, int offset, int frames);
+};
+
+// a ugen written in python. process(inputs, outputs) is called once for each
+// range of frames, with views of the blocks restricted to that range. it
+// takes the GIL, so it is pinned to the audio thread.
+struct PythonUGen: UGen, boost::python::wrapper<PythonUGen>
+{
+    // views of the whole blocks, reused as long as the blocks stay the same
+    boost::python::object inputs;
+    boost::python::object outputs;
+    Sample *viewed;
+
+    // the python object, kept alive while the node is connected: the
+    // wrapper only holds a borrowed reference
+    boost::python::handle<> self;
+
+    // process() raised: the error was reported, and the node stays asleep
+    bool failed;
+
+    PythonUGen(int inputs, int outputs);
+    ~PythonUGen();
+
+    bool quiet(bool silentInput);
+    void connect();
+    bool release(UGenPtr& owner);
+    void process(int offset, int frames);
 };
 
 struct Route: public boost::enable_shared_from_this<Route>
 {
+    // shape of the gain matrix, used to pick a mixing kernel
+    enum Kind {
+        DENSE, // any matrix
+        IDENTITY, // n->n, only the diagonal is used
+        BROADCAST, // 1->n
+        SUMDOWN, // n->1
+        MUTE // all zeros, nothing to mix
+    };
+
     int sourceSize;
     int targetSize;
-    boost::shared_array<int> weights;
+    int kind;
+    boost::shared_array<Sample> weights;
     
+    // routes are small and numerous: they live in the arena
+    static void *operator new(size_t bytes);
+    static void operator delete(void *block, size_t bytes);
+
     Route(int sourceSize, int targetSize);
     Route(UGenPtr source, UGenPtr target);
     Route(boost::python::list weights);
     void init();
+    void classify();
     ~Route();
+
+    Sample getGain(int source, int target);
+    void setGain(int source, int target, Sample gain);
     
-    void fetch(UGenPtr source, UGenPtr target);
+    void fetch(UGen *source, UGen *target, int offset, int frames);
+
+    typedef void (*Kernel)(int kind, Sample const* weights, int sourceSize, int targetSize,
+            UGen *source, UGen *target, int offset, int frames);
+
+    static void mix(int kind, Sample const* weights, int sourceSize, int targetSize,
+            UGen *source, UGen *target, int offset, int frames);
+
+    // mix, or a version of it compiled for the given number of channels
+    static Kernel kernel(int kind, int sourceSize, int targetSize);
+};
+
+// a compiled connection: mix the output of nodes[source] through the
+// weights stored inline in the schedule
+struct Edge
+{
+    int source;
+    int kind;
+    int sourceSize;
+    int targetSize;
+    int weights; // offset in Schedule::weights
+    Route::Kernel mix; // picked when the schedule is compiled
+};
+
+// the graph reachable from a root node, flattened in evaluation order. the
+// edges feeding nodes[i] are edges[first[i]] to edges[first[i+1]-1].
+struct Schedule
+{
+    std::vector<UGenPtr> owners; // keep the nodes alive
+    std::vector<UGen*> nodes;
+    std::vector<int> first;
+    std::vector<Edge> edges;
+    std::vector<Sample> weights;
+
+    // the nodes are grouped in independent subgraphs, the biggest first.
+    // tasks[k] is the first node of subgraph k, the root comes last. the
+    // subgraphs holding a pinned node come after the others, from
+    // tasks[pinned] on.
+    std::vector<int> tasks;
+    int pinned;
+
+    std::vector<int> delays; // the feedback nodes, stored after the root
+    std::vector<int> gates; // gate of each node, -1 if none or unscheduled
+
+    Time time; // when it replaces the previous one
+    Schedule *next; // in the published, upcoming or retired list
+
+    // nodes whose blocks do not hold blockSize frames get new ones
+    void compile(UGenPtr root, int blockSize);
+    void visit(UGenPtr ugen, std::map<UGen*, int>& index);
+    void partition(std::map<UGen*, int>& index);
+    bool release();
+    void run(Time time, int offset, int frames);
+    void runTask(int task, Time time, int offset, int frames);
+    void runNodes(int begin, int end, Time time, int offset, int frames);
+    bool gated(int node);
+    bool mixInputs(int node, int offset, int frames);
+};
+
+// threads helping the audio thread with the independent subgraphs of a
+// schedule. each batch is published as a counter, and every thread claims
+// the next task until none is left, so free threads take over the work of
+// busy ones. the audio thread waits for all of them before running the root.
+struct Pool
+{
+    std::vector< boost::shared_ptr<boost::thread> > threads;
+    boost::atomic<bool> alive;
+    boost::atomic<boost::uint64_t> ticket; // tasks in the batch, next task
+    boost::atomic<int> done; // tasks finished in the batch
+
+    // idle threads end up waiting for the next batch
+    boost::mutex mutex;
+    boost::condition_variable wake;
+    boost::atomic<int> sleeping;
+
+    // scheduling of the audio thread, copied by the workers once known
+    boost::atomic<bool> tuned;
+    int policy;
+    int priority;
+
+    // the batch being run, written before the ticket is published
+    Schedule *schedule;
+    Time time;
+    int offset;
+    int frames;
+
+    Pool();
+    ~Pool();
+
+    int size();
+    void start(int size);
+    void stop();
+    void run(Schedule *schedule, Time time, int offset, int frames);
+    bool help();
+    void work();
+};
+
+// what the engine is doing, counted by the audio thread and read from python
+// at any time. the callback histogram has one bucket per tenth of the
+// deadline, the last one counting the callbacks past it.
+struct Metrics
+{
+    static const int buckets = 11;
+
+    Counter callbacks;
+    Counter histogram[buckets];
+    Counter busy; // nanoseconds spent in callbacks
+    Counter worst;
+    Counter underflows; // reported by the audio device
+    Counter overflows;
+    Counter gilWait; // nanoseconds the audio thread waited for the GIL
+    Counter gilTaken;
+    Counter blocks;
+    Counter shreds; // shreds resumed
+    Counter mostShreds; // in a single block
+    boost::atomic<bool> profiling; // time every node
+
+    Metrics();
+
+    static unsigned long nanoseconds();
+    void reset();
+    void cycle(unsigned long elapsed, unsigned long deadline);
+    PyGILState_STATE ensure();
+};
+
+// a control value of a ugen, either fixed or moving towards a target. ugens
+// with moving parameters advance them once per control period.
+struct Param
+{
+    enum Mode {FIXED, LINEAR, EXPONENTIAL, SMOOTH};
+    static const int controlPeriod = 16;
+
+    float value;
+    float target;
+    int mode;
+    double step; // increment, ratio or decay per frame, depending on mode
+    Duration remaining; // frames left in a linear or exponential ramp
+
+    Param(float value = 0);
+    operator float() const { return value; }
+
+    bool moving() const { return mode != FIXED; }
+    void ramp(int mode, float target, Duration frames);
+    void advance(int frames);
+};
+
+// a change to apply from the audio thread, at the sample given by its time. a
+// command is built and deleted on the control side, so it may own anything.
+struct Command
+{
+    Time time; // apply at this time, or as soon as possible if already past
+    Command *next; // in the queue of the target ugen
+
+    Command();
+    virtual ~Command();
+    virtual void apply() = 0;
+
+    // the only ugen affected by this command, if any. such commands only
+    // split the processing of that ugen, others split the whole graph.
+    virtual UGen *target();
+};
+
+// swap a value owned by a ugen with a new one, then reinitialize the ugen.
+// the previous value ends up in the command and is released with it.
+template <typename T>
+struct SetCommand : Command
+{
+    UGenPtr ugen;
+    T *field;
+    T value;
+
+    SetCommand(UGenPtr ugen, T *field, T value)
+        : Command(), ugen(ugen), field(field), value(value)
+    {}
+
+    void apply()
+    {
+        std::swap(*field, value);
+        ugen->init();
+    }
+
+    UGen *target()
+    {
+        return ugen.get();
+    }
+};
+
+// add a shred to the shreduler queue
+struct ShredCommand : Command
+{
+    ShredPtr shred;
+
+    ShredCommand(ShredPtr shred);
+    void apply();
+};
+
+// start moving a parameter from wherever it is when the command is applied
+struct RampCommand : Command
+{
+    UGenPtr ugen;
+    Param *param;
+    int mode;
+    float value;
+    Duration frames;
+
+    RampCommand(UGenPtr ugen, Param *param, int mode, float value, Duration frames);
+    void apply();
+    UGen *target();
+};
+
+// python handle on a parameter, as returned by ugen properties:
+// osc.freq.rampTo(880, ms(50))
+struct ParamRef
+{
+    // the values accepted by the setter of the parameter, if it checks them
+    typedef bool (*Check)(float value);
+
+    UGenPtr ugen;
+    Param *param;
+    Check check;
+
+    ParamRef(UGenPtr ugen, Param *param, Check check = NULL);
+    operator float() const { return param->value; }
+
+    float getValue();
+    float getTarget();
+    bool moving();
+    void rampTo(float value, Duration frames);
+    void expTo(float value, Duration frames);
+    void smooth(float value, Duration frames);
+    void validate(float value);
 };
 
 struct Shred: public boost::enable_shared_from_this<Shred>
 {
     boost::python::object gen; // call this (generator)
     Time next; // at this time
+    ShredPtr following; // in the same list of the timing wheel
     
     Shred(boost::python::object gen, Time t);
     Shred(boost::python::object gen);
-    ~Shred();
+    virtual ~Shred();
     
+    virtual void run();
+    virtual void run(boost::python::object args);
+    void handleYield(boost::python::object yield);
+    virtual void kill();
+};
+
+// a shred written in C++, so that control loops run without going through the
+// interpreter. resume() is a stackless coroutine in the style of
+// boost::asio::coroutine: its body goes in a reenter (this) { ... } block and
+// suspends with yield sleep(duration), yield wait(event) or a bare yield.
+struct NativeShred: public Shred, public boost::asio::coroutine
+{
+    enum Wait {NOW, SLEEP, EVENT};
+
+    int waiting; // what the last yield asked for
+    Duration duration;
+    EventPtr event;
+    boost::python::object received; // args of the event that woke it up
+    bool dead;
+
+    NativeShred();
+    ~NativeShred();
+
     void run();
     void run(boost::python::object args);
-    void handleYield(boost::python::object yield);
     void kill();
+
+    void sleep(Duration duration);
+    void wait(EventPtr event);
+    bool isDone();
+
+    virtual void resume() = 0;
 };
 
 struct Event: public boost::enable_shared_from_this<Event>
@@ -133,36 +581,184 @@ struct Event: public boost::enable_shared_from_this<Event>
     void signal(boost::python::object args);
 };
 
+// shreds linked through Shred::following, in the order they were appended.
+// moving a shred from a list to another never allocates, so the wheel can be
+// used from the audio thread.
+struct ShredList
+{
+    ShredPtr first;
+    Shred *last;
+
+    ShredList() : last(NULL) {}
+
+    bool empty() const { return !first; }
+    void append(ShredPtr shred);
+    ShredPtr take(); // the whole chain, leaving the list empty
+    Time earliest();
+    void clear();
+};
+
+// shreds waiting for their time, in a hierarchical timing wheel: a shred
+// sits at the level of the highest byte where its time differs from the
+// current time, and moves down a level whenever the current time enters its
+// slot. inserting is O(1), and a bitmap per level skips the empty slots
+// when looking for the next shred due. a shred waits in one slot at most.
+struct ShredWheel
+{
+    static const int levels = 4;
+    static const int slots = 256;
+    static const Time never = (Time) -1;
+
+    Time current; // no shred is due before
+    ShredList wheel[levels][slots];
+    boost::uint64_t occupied[levels][slots/64];
+    ShredList overflow; // beyond the last level
+    ShredList late; // inserted behind the current time
+    int count;
+
+    // time of the next shred due, or of the slot holding it when that is
+    // after the time popped last, so pop() may find nothing yet. readable
+    // from any thread. only the owner of the wheel (the thread holding the
+    // GIL, or the audio thread in callback mode) changes it.
+    boost::atomic<Time> wake;
+
+    ShredWheel();
+    ~ShredWheel();
+
+    bool empty();
+    int size();
+    void clear();
+    void push(ShredPtr shred);
+
+    // the shreds due first, if not after until, chained through following
+    ShredPtr pop(Time until);
+
+    // the time of the next shred if not after until, or a time between until
+    // and that one. the current time does not move past until.
+    Time next(Time until);
+    void moveTo(Time time);
+    void cascade(int level, int slot);
+    int findSlot(int level, int from);
+};
+
 struct Server
 {
     static ServerPtr singleton;
+    static const unsigned int defaultBufferFrames = 256;
     
     RtAudio audio;
     RtAudio::DeviceInfo info;
     RtAudio::StreamParameters inputParams, outputParams;
     unsigned int bufferFrames; // number of frames processed at once
+    bool offline; // no audio device, driven by render()
     PyGILState_STATE gstate;
     
-    Time now;
+    boost::atomic<Time> clock; // time of the next sample to compute
+    // logical time of the shred running on each thread, null outside shreds:
+    // the time of a shred never leaks to the commands of other threads
+    boost::thread_specific_ptr<Time> shredTime;
     Samplerate srate;
     UGenPtr io;
 
-    ShredQueue queue;
+    // the stream is planar, like the io blocks, which are bound to the
+    // device buffers in each callback. these are the blocks of their own.
+    boost::shared_array<Sample> ioInput;
+    boost::shared_array<Sample> ioOutput;
+
+    // when lookahead is not zero, shreds run on their own thread, up to
+    // lookahead samples ahead of the audio clock. their commands are
+    // timestamped and applied by the audio thread at the right sample.
+    ShredWheel queue;
+    Duration lookahead;
+    boost::thread shreduler;
+    boost::atomic<bool> shreduling;
+
+    // compiled on the control side, once for a burst of topology changes,
+    // and published on a lock-free list, newest first. the audio thread moves
+    // them to upcoming, oldest first, switches to each one when due and
+    // hands the one it replaces back through the retired list. latest is the
+    // last one published. dirty is only used with the GIL held.
+    Schedule *schedule;
+    Schedule *latest;
+    boost::atomic<Schedule*> published;
+    Schedule *upcoming;
+    boost::atomic<Schedule*> retired;
+    bool dirty;
+
+    // when not empty, runs the schedule on several threads
+    Pool pool;
+
+    Metrics metrics;
+
+    bool running;
+    CommandQueue commands;
+    CommandReturn applied;
+    boost::atomic<int> pending; // applied commands not yet collected
+    int held; // received commands not yet applied
+    boost::atomic<unsigned long> dropped; // commands lost to a full queue
+    std::vector<Command*> waiting; // received but not yet due, sorted by time
+    std::vector<UGen*> touched; // ugens with queued commands in this block
+    size_t dispatched; // commands at the front of waiting queued on ugens
+
+    // applied commands are deleted by the reclaim thread, so that nothing
+    // is freed by the audio thread. collect() may run on several threads.
+    boost::thread reclaimer;
+    boost::atomic<bool> reclaiming;
+    boost::mutex collecting;
+    boost::mutex reclaimMutex;
+    boost::condition_variable reclaimWake;
     
     Server(int channels);
+    Server(int channels, Samplerate srate, unsigned int bufferFrames);
     ~Server();
+    void setup(int channels);
     
     static ServerPtr open(int channels);
+    static ServerPtr openOffline(int channels, Samplerate srate, unsigned int bufferFrames);
     void start();
     void stop();
     void close();
 
-    void tick();
+    static void post(Command *command);
+    static void invalidate();
+    static void keepTime(Time *time);
+    bool inShred();
+    Time stamp();
+    void compile();
+    void drain(Time until);
+    int dispatch(int frames);
+    void settle();
+    void retire(Command *command);
+    void retire(Schedule *schedule);
+    void adopt(Time until);
+    void collect();
+    void reclaim();
+    void process(int frames);
+    void cycle(Sample const *input, Sample *output, unsigned int frames);
+    void cyclePlanar(Sample *input, Sample *output, unsigned int frames);
+    void shredule();
+
+    // offline rendering, as fast as possible from the calling thread. input
+    // is silent, output is interleaved.
+    void render(Sample *output, Duration frames);
+    boost::python::object renderBuffer(Duration frames);
+    void renderFile(std::string filename, Duration frames);
     
     Time getNow();
+    Duration getLookahead();
+    void setLookahead(Duration lookahead);
     Samplerate getSrate();
+    unsigned long getDropped();
+    int getWorkers();
+    void setWorkers(int workers);
     UGenPtr getIO();
 
+    boost::python::dict getMetrics();
+    void resetMetrics();
+    bool getProfiling();
+    void setProfiling(bool profiling);
+    boost::python::dict profile();
+
     ShredPtr spork(boost::python::object gen);
     void addShred(ShredPtr shred);
 };
@@ -0,0 +1,669 @@
+#include "simd.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+// the vector kernels work on floats: double samples use the scalar ones
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(PYCK_DOUBLE)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+static const Sample PI = 3.14159265358979f;
+static const Sample TWO_PI = 6.28318530717959f;
+static const Sample INV_TWO_PI = 0.159154943091895f;
+
+// taylor coefficients of sin, good to ~1e-7 on [-pi/2, pi/2]
+static const Sample S3 = -1.0f / 6;
+static const Sample S5 = 1.0f / 120;
+static const Sample S7 = -1.0f / 5040;
+static const Sample S9 = 1.0f / 362880;
+static const Sample S11 = -1.0f / 39916800;
+
+// scalar kernels
+///////////////////////////////////////////////////////////////////////////////
+
+static void mixAddScalar(Sample *out, Sample const *in, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        out[i] += in[i];
+    }
+}
+
+static void mixScaledScalar(Sample *out, Sample const *in, Sample gain, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        out[i] += in[i] * gain;
+    }
+}
+
+static void mixPairScalar(Sample *out, Sample const *in0, Sample gain0,
+        Sample const *in1, Sample gain1, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        Sample o = out[i] + in0[i] * gain0;
+        out[i] = o + in1[i] * gain1;
+    }
+}
+
+Sample wrapPhase(Sample phase)
+{
+    // phases never go below -pi, so truncating is flooring here
+    return phase - TWO_PI * (int) ((phase + PI) * INV_TWO_PI);
+}
+
+static Sample oscPhaseScalar(Sample *phases, Sample start, Sample w, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        phases[i] = wrapPhase(start + i*w);
+    }
+    return wrapPhase(start + frames*w);
+}
+
+static inline Sample sinScalar(Sample x)
+{
+    // fold to [0, pi/2] with sin(x) = sin(pi-x) and sin(-x) = -sin(x)
+    Sample a = std::fabs(x);
+    a = std::min(a, PI - a);
+    Sample a2 = a*a;
+    Sample y = a * (1 + a2*(S3 + a2*(S5 + a2*(S7 + a2*(S9 + a2*S11)))));
+    return x < 0 ? -y : y;
+}
+
+static void oscSinScalar(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        out[i] = gain * sinScalar(phases[i]);
+    }
+}
+
+static void oscSawScalar(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    Sample g = gain / PI;
+    for (int i=0; i<frames; i++) {
+        out[i] = phases[i] * g;
+    }
+}
+
+static void oscPulseScalar(Sample *out, Sample const *phases, Sample edge, Sample gain, int frames)
+{
+    for (int i=0; i<frames; i++) {
+        out[i] = edge < phases[i] ? gain : -gain;
+    }
+}
+
+static void oscTriScalar(Sample *out, Sample const *phases, Sample width, Sample gain, int frames)
+{
+    // slopes of the rising and falling parts, zero when they are degenerated
+    Sample pw = PI * width;
+    Sample rise = 0 < pw ? gain / pw : 0;
+    Sample fall = pw < PI ? gain / (PI - pw) : 0;
+    for (int i=0; i<frames; i++) {
+        Sample a = std::fabs(phases[i]);
+        Sample y = a <= pw ? a * rise : (PI - a) * fall;
+        out[i] = phases[i] < 0 ? -y : y;
+    }
+}
+
+static void oscBankScalar(Sample *out, Sample *scratch, Sample *phases,
+        Sample const *w, Sample const *gains, int count, int frames)
+{
+    for (int n=0; n<count; n++) {
+        Sample p = phases[n];
+        for (int k=0; k<frames; k++) {
+            out[k] += gains[n] * sinScalar(p);
+            p += w[n];
+            if (PI <= p) {
+                p -= TWO_PI;
+            }
+        }
+        phases[n] = p;
+    }
+}
+
+static void interleaveScalar(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    for (int c=0; c<channels; c++) {
+        Sample const *src = in + c*stride;
+        Sample *dst = out + c;
+        for (int i=0; i<frames; i++) {
+            dst[i*channels] = src[i];
+        }
+    }
+}
+
+static void deinterleaveScalar(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    for (int c=0; c<channels; c++) {
+        Sample const *src = in + c;
+        Sample *dst = out + c*stride;
+        for (int i=0; i<frames; i++) {
+            dst[i] = src[i*channels];
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+// SSE kernels
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("sse2")))
+static void mixAddSSE(Sample *out, Sample const *in, int frames)
+{
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 o = _mm_loadu_ps(out + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(o, _mm_loadu_ps(in + i)));
+    }
+    mixAddScalar(out + i, in + i, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void mixScaledSSE(Sample *out, Sample const *in, Sample gain, int frames)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 o = _mm_loadu_ps(out + i);
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+        _mm_storeu_ps(out + i, _mm_add_ps(o, x));
+    }
+    mixScaledScalar(out + i, in + i, gain, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void mixPairSSE(Sample *out, Sample const *in0, Sample gain0,
+        Sample const *in1, Sample gain1, int frames)
+{
+    __m128 g0 = _mm_set1_ps(gain0);
+    __m128 g1 = _mm_set1_ps(gain1);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 o = _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in0 + i), g0));
+        _mm_storeu_ps(out + i, _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(in1 + i), g1)));
+    }
+    mixPairScalar(out + i, in0 + i, gain0, in1 + i, gain1, frames - i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 wrapSSE(__m128 p)
+{
+    __m128 t = _mm_mul_ps(_mm_add_ps(p, _mm_set1_ps(PI)), _mm_set1_ps(INV_TWO_PI));
+    __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    return _mm_sub_ps(p, _mm_mul_ps(n, _mm_set1_ps(TWO_PI)));
+}
+
+__attribute__((target("sse2")))
+static Sample oscPhaseSSE(Sample *phases, Sample start, Sample w, int frames)
+{
+    __m128 ramp = _mm_mul_ps(_mm_set_ps(3, 2, 1, 0), _mm_set1_ps(w));
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 p = _mm_add_ps(_mm_set1_ps(start + i*w), ramp);
+        _mm_storeu_ps(phases + i, wrapSSE(p));
+    }
+    for (; i<frames; i++) {
+        phases[i] = wrapPhase(start + i*w);
+    }
+    return wrapPhase(start + frames*w);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 sinSSE(__m128 x)
+{
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 s = _mm_and_ps(x, sign);
+    __m128 a = _mm_andnot_ps(sign, x);
+    a = _mm_min_ps(a, _mm_sub_ps(_mm_set1_ps(PI), a));
+    __m128 a2 = _mm_mul_ps(a, a);
+    __m128 y = _mm_set1_ps(S11);
+    y = _mm_add_ps(_mm_mul_ps(y, a2), _mm_set1_ps(S9));
+    y = _mm_add_ps(_mm_mul_ps(y, a2), _mm_set1_ps(S7));
+    y = _mm_add_ps(_mm_mul_ps(y, a2), _mm_set1_ps(S5));
+    y = _mm_add_ps(_mm_mul_ps(y, a2), _mm_set1_ps(S3));
+    y = _mm_add_ps(_mm_mul_ps(y, a2), _mm_set1_ps(1));
+    return _mm_xor_ps(_mm_mul_ps(y, a), s);
+}
+
+__attribute__((target("sse2")))
+static void oscSinSSE(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    __m128 g = _mm_set1_ps(gain);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(sinSSE(_mm_loadu_ps(phases + i)), g));
+    }
+    oscSinScalar(out + i, phases + i, gain, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void oscSawSSE(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    __m128 g = _mm_set1_ps(gain / PI);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(phases + i), g));
+    }
+    oscSawScalar(out + i, phases + i, gain, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void oscPulseSSE(Sample *out, Sample const *phases, Sample edge, Sample gain, int frames)
+{
+    __m128 e = _mm_set1_ps(edge);
+    __m128 high = _mm_set1_ps(gain);
+    __m128 low = _mm_set1_ps(-gain);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 m = _mm_cmplt_ps(e, _mm_loadu_ps(phases + i));
+        _mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(m, high), _mm_andnot_ps(m, low)));
+    }
+    oscPulseScalar(out + i, phases + i, edge, gain, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void oscTriSSE(Sample *out, Sample const *phases, Sample width, Sample gain, int frames)
+{
+    Sample pw = PI * width;
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 peak = _mm_set1_ps(pw);
+    __m128 rise = _mm_set1_ps(0 < pw ? gain / pw : 0);
+    __m128 fall = _mm_set1_ps(pw < PI ? gain / (PI - pw) : 0);
+    int i = 0;
+    for (; i+4 <= frames; i+=4) {
+        __m128 x = _mm_loadu_ps(phases + i);
+        __m128 a = _mm_andnot_ps(sign, x);
+        __m128 m = _mm_cmple_ps(a, peak);
+        __m128 up = _mm_mul_ps(a, rise);
+        __m128 down = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(PI), a), fall);
+        __m128 y = _mm_or_ps(_mm_and_ps(m, up), _mm_andnot_ps(m, down));
+        _mm_storeu_ps(out + i, _mm_xor_ps(y, _mm_and_ps(x, sign)));
+    }
+    oscTriScalar(out + i, phases + i, width, gain, frames - i);
+}
+
+__attribute__((target("sse2")))
+static void oscBankSSE(Sample *out, Sample *scratch, Sample *phases,
+        Sample const *w, Sample const *gains, int count, int frames)
+{
+    // one lane per oscillator, partial sums of each frame kept in scratch
+    for (int k=0; k<frames; k++) {
+        _mm_storeu_ps(scratch + 4*k, _mm_setzero_ps());
+    }
+
+    __m128 pi = _mm_set1_ps(PI);
+    __m128 twoPi = _mm_set1_ps(TWO_PI);
+    int n = 0;
+    for (; n+4 <= count; n+=4) {
+        __m128 p = _mm_loadu_ps(phases + n);
+        __m128 dw = _mm_loadu_ps(w + n);
+        __m128 g = _mm_loadu_ps(gains + n);
+        for (int k=0; k<frames; k++) {
+            __m128 acc = _mm_loadu_ps(scratch + 4*k);
+            _mm_storeu_ps(scratch + 4*k, _mm_add_ps(acc, _mm_mul_ps(sinSSE(p), g)));
+            p = _mm_add_ps(p, dw);
+            p = _mm_sub_ps(p, _mm_and_ps(_mm_cmpge_ps(p, pi), twoPi));
+        }
+        _mm_storeu_ps(phases + n, p);
+    }
+
+    for (int k=0; k<frames; k++) {
+        Sample *acc = scratch + 4*k;
+        out[k] += acc[0] + acc[1] + acc[2] + acc[3];
+    }
+    oscBankScalar(out, scratch, phases + n, w + n, gains + n, count - n, frames);
+}
+
+// channels go by pairs, four frames at a time: a pair of frames is 64 bits
+// of the interleaved buffer. an odd last channel is left to the scalar code.
+__attribute__((target("sse2")))
+static void interleaveSSE(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    int c = 0;
+    for (; c+2 <= channels; c+=2) {
+        Sample const *l = in + c*stride;
+        Sample const *r = l + stride;
+        Sample *dst = out + c;
+        int i = 0;
+        for (; i+4 <= frames; i+=4) {
+            __m128 a = _mm_loadu_ps(l + i);
+            __m128 b = _mm_loadu_ps(r + i);
+            __m128 lo = _mm_unpacklo_ps(a, b);
+            __m128 hi = _mm_unpackhi_ps(a, b);
+            if (channels == 2) {
+                _mm_storeu_ps(dst + 2*i, lo);
+                _mm_storeu_ps(dst + 2*i + 4, hi);
+            } else {
+                _mm_storel_pi((__m64 *) (dst + i*channels), lo);
+                _mm_storeh_pi((__m64 *) (dst + (i+1)*channels), lo);
+                _mm_storel_pi((__m64 *) (dst + (i+2)*channels), hi);
+                _mm_storeh_pi((__m64 *) (dst + (i+3)*channels), hi);
+            }
+        }
+        for (; i<frames; i++) {
+            dst[i*channels] = l[i];
+            dst[i*channels + 1] = r[i];
+        }
+    }
+    for (; c<channels; c++) {
+        for (int i=0; i<frames; i++) {
+            out[i*channels + c] = in[c*stride + i];
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void deinterleaveSSE(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    int c = 0;
+    for (; c+2 <= channels; c+=2) {
+        Sample const *src = in + c;
+        Sample *l = out + c*stride;
+        Sample *r = l + stride;
+        int i = 0;
+        for (; i+4 <= frames; i+=4) {
+            __m128 a = _mm_setzero_ps();
+            __m128 b = _mm_setzero_ps();
+            a = _mm_loadl_pi(a, (__m64 const *) (src + i*channels));
+            a = _mm_loadh_pi(a, (__m64 const *) (src + (i+1)*channels));
+            b = _mm_loadl_pi(b, (__m64 const *) (src + (i+2)*channels));
+            b = _mm_loadh_pi(b, (__m64 const *) (src + (i+3)*channels));
+            _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        for (; i<frames; i++) {
+            l[i] = src[i*channels];
+            r[i] = src[i*channels + 1];
+        }
+    }
+    for (; c<channels; c++) {
+        for (int i=0; i<frames; i++) {
+            out[c*stride + i] = in[i*channels + c];
+        }
+    }
+}
+
+// AVX kernels
+///////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx")))
+static void mixAddAVX(Sample *out, Sample const *in, int frames)
+{
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 o = _mm256_loadu_ps(out + i);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(o, _mm256_loadu_ps(in + i)));
+    }
+    mixAddScalar(out + i, in + i, frames - i);
+}
+
+__attribute__((target("avx")))
+static void mixScaledAVX(Sample *out, Sample const *in, Sample gain, int frames)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 o = _mm256_loadu_ps(out + i);
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in + i), g);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(o, x));
+    }
+    mixScaledScalar(out + i, in + i, gain, frames - i);
+}
+
+__attribute__((target("avx")))
+static void mixPairAVX(Sample *out, Sample const *in0, Sample gain0,
+        Sample const *in1, Sample gain1, int frames)
+{
+    __m256 g0 = _mm256_set1_ps(gain0);
+    __m256 g1 = _mm256_set1_ps(gain1);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 o = _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(_mm256_loadu_ps(in0 + i), g0));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(o, _mm256_mul_ps(_mm256_loadu_ps(in1 + i), g1)));
+    }
+    mixPairScalar(out + i, in0 + i, gain0, in1 + i, gain1, frames - i);
+}
+
+__attribute__((target("avx")))
+static inline __m256 wrapAVX(__m256 p)
+{
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(p, _mm256_set1_ps(PI)), _mm256_set1_ps(INV_TWO_PI));
+    __m256 n = _mm256_cvtepi32_ps(_mm256_cvttps_epi32(t));
+    return _mm256_sub_ps(p, _mm256_mul_ps(n, _mm256_set1_ps(TWO_PI)));
+}
+
+__attribute__((target("avx")))
+static Sample oscPhaseAVX(Sample *phases, Sample start, Sample w, int frames)
+{
+    __m256 ramp = _mm256_mul_ps(_mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0), _mm256_set1_ps(w));
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 p = _mm256_add_ps(_mm256_set1_ps(start + i*w), ramp);
+        _mm256_storeu_ps(phases + i, wrapAVX(p));
+    }
+    for (; i<frames; i++) {
+        phases[i] = wrapPhase(start + i*w);
+    }
+    return wrapPhase(start + frames*w);
+}
+
+__attribute__((target("avx")))
+static inline __m256 sinAVX(__m256 x)
+{
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 s = _mm256_and_ps(x, sign);
+    __m256 a = _mm256_andnot_ps(sign, x);
+    a = _mm256_min_ps(a, _mm256_sub_ps(_mm256_set1_ps(PI), a));
+    __m256 a2 = _mm256_mul_ps(a, a);
+    __m256 y = _mm256_set1_ps(S11);
+    y = _mm256_add_ps(_mm256_mul_ps(y, a2), _mm256_set1_ps(S9));
+    y = _mm256_add_ps(_mm256_mul_ps(y, a2), _mm256_set1_ps(S7));
+    y = _mm256_add_ps(_mm256_mul_ps(y, a2), _mm256_set1_ps(S5));
+    y = _mm256_add_ps(_mm256_mul_ps(y, a2), _mm256_set1_ps(S3));
+    y = _mm256_add_ps(_mm256_mul_ps(y, a2), _mm256_set1_ps(1));
+    return _mm256_xor_ps(_mm256_mul_ps(y, a), s);
+}
+
+__attribute__((target("avx")))
+static void oscSinAVX(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    __m256 g = _mm256_set1_ps(gain);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(sinAVX(_mm256_loadu_ps(phases + i)), g));
+    }
+    oscSinScalar(out + i, phases + i, gain, frames - i);
+}
+
+__attribute__((target("avx")))
+static void oscSawAVX(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    __m256 g = _mm256_set1_ps(gain / PI);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(phases + i), g));
+    }
+    oscSawScalar(out + i, phases + i, gain, frames - i);
+}
+
+__attribute__((target("avx")))
+static void oscPulseAVX(Sample *out, Sample const *phases, Sample edge, Sample gain, int frames)
+{
+    __m256 e = _mm256_set1_ps(edge);
+    __m256 high = _mm256_set1_ps(gain);
+    __m256 low = _mm256_set1_ps(-gain);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 m = _mm256_cmp_ps(e, _mm256_loadu_ps(phases + i), _CMP_LT_OQ);
+        _mm256_storeu_ps(out + i, _mm256_blendv_ps(low, high, m));
+    }
+    oscPulseScalar(out + i, phases + i, edge, gain, frames - i);
+}
+
+__attribute__((target("avx")))
+static void oscTriAVX(Sample *out, Sample const *phases, Sample width, Sample gain, int frames)
+{
+    Sample pw = PI * width;
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 peak = _mm256_set1_ps(pw);
+    __m256 rise = _mm256_set1_ps(0 < pw ? gain / pw : 0);
+    __m256 fall = _mm256_set1_ps(pw < PI ? gain / (PI - pw) : 0);
+    int i = 0;
+    for (; i+8 <= frames; i+=8) {
+        __m256 x = _mm256_loadu_ps(phases + i);
+        __m256 a = _mm256_andnot_ps(sign, x);
+        __m256 m = _mm256_cmp_ps(a, peak, _CMP_LE_OQ);
+        __m256 up = _mm256_mul_ps(a, rise);
+        __m256 down = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(PI), a), fall);
+        __m256 y = _mm256_blendv_ps(down, up, m);
+        _mm256_storeu_ps(out + i, _mm256_xor_ps(y, _mm256_and_ps(x, sign)));
+    }
+    oscTriScalar(out + i, phases + i, width, gain, frames - i);
+}
+
+__attribute__((target("avx")))
+static void oscBankAVX(Sample *out, Sample *scratch, Sample *phases,
+        Sample const *w, Sample const *gains, int count, int frames)
+{
+    // one lane per oscillator, partial sums of each frame kept in scratch
+    for (int k=0; k<frames; k++) {
+        _mm256_storeu_ps(scratch + 8*k, _mm256_setzero_ps());
+    }
+
+    __m256 pi = _mm256_set1_ps(PI);
+    __m256 twoPi = _mm256_set1_ps(TWO_PI);
+    int n = 0;
+    for (; n+8 <= count; n+=8) {
+        __m256 p = _mm256_loadu_ps(phases + n);
+        __m256 dw = _mm256_loadu_ps(w + n);
+        __m256 g = _mm256_loadu_ps(gains + n);
+        for (int k=0; k<frames; k++) {
+            __m256 acc = _mm256_loadu_ps(scratch + 8*k);
+            _mm256_storeu_ps(scratch + 8*k, _mm256_add_ps(acc, _mm256_mul_ps(sinAVX(p), g)));
+            p = _mm256_add_ps(p, dw);
+            p = _mm256_sub_ps(p, _mm256_and_ps(_mm256_cmp_ps(p, pi, _CMP_GE_OQ), twoPi));
+        }
+        _mm256_storeu_ps(phases + n, p);
+    }
+
+    for (int k=0; k<frames; k++) {
+        __m128 acc = _mm_add_ps(_mm_loadu_ps(scratch + 8*k), _mm_loadu_ps(scratch + 8*k + 4));
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        out[k] += _mm_cvtss_f32(acc);
+    }
+    oscBankScalar(out, scratch, phases + n, w + n, gains + n, count - n, frames);
+}
+
+// shuffles gain nothing from wider registers
+static void interleaveAVX(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    interleaveSSE(out, in, channels, stride, frames);
+}
+
+static void deinterleaveAVX(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    deinterleaveSSE(out, in, channels, stride, frames);
+}
+
+#endif
+
+// runtime dispatch
+///////////////////////////////////////////////////////////////////////////////
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE, SIMD_AVX };
+
+static SimdLevel detect()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return SIMD_AVX;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+static SimdLevel level = detect();
+
+#ifdef SIMD_X86
+#define DISPATCH(kernel, args) \
+    switch (level) { \
+    case SIMD_AVX: return kernel##AVX args; \
+    case SIMD_SSE: return kernel##SSE args; \
+    default: return kernel##Scalar args; \
+    }
+#else
+#define DISPATCH(kernel, args) \
+    return kernel##Scalar args;
+#endif
+
+void mixAdd(Sample *out, Sample const *in, int frames)
+{
+    DISPATCH(mixAdd, (out, in, frames))
+}
+
+void mixScaled(Sample *out, Sample const *in, Sample gain, int frames)
+{
+    DISPATCH(mixScaled, (out, in, gain, frames))
+}
+
+void mixPair(Sample *out, Sample const *in0, Sample gain0,
+        Sample const *in1, Sample gain1, int frames)
+{
+    DISPATCH(mixPair, (out, in0, gain0, in1, gain1, frames))
+}
+
+Sample oscPhase(Sample *phases, Sample start, Sample w, int frames)
+{
+    DISPATCH(oscPhase, (phases, start, w, frames))
+}
+
+void oscSin(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    DISPATCH(oscSin, (out, phases, gain, frames))
+}
+
+void oscSaw(Sample *out, Sample const *phases, Sample gain, int frames)
+{
+    DISPATCH(oscSaw, (out, phases, gain, frames))
+}
+
+void oscPulse(Sample *out, Sample const *phases, Sample edge, Sample gain, int frames)
+{
+    DISPATCH(oscPulse, (out, phases, edge, gain, frames))
+}
+
+void oscTri(Sample *out, Sample const *phases, Sample width, Sample gain, int frames)
+{
+    DISPATCH(oscTri, (out, phases, width, gain, frames))
+}
+
+void oscBank(Sample *out, Sample *scratch, Sample *phases,
+        Sample const *w, Sample const *gains, int count, int frames)
+{
+    DISPATCH(oscBank, (out, scratch, phases, w, gains, count, frames))
+}
+
+void interleave(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    DISPATCH(interleave, (out, in, channels, stride, frames))
+}
+
+void deinterleave(Sample *out, Sample const *in, int channels, int stride, int frames)
+{
+    DISPATCH(deinterleave, (out, in, channels, stride, frames))
+}
+
+const char *simdName()
+{
+    switch (level) {
+    case SIMD_AVX: return "avx";
+    case SIMD_SSE: return "sse";
+    default: return "scalar";
+    }
+}
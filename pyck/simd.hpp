@@ -0,0 +1,55 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include "core.hpp"
+
+// Block kernels used in the hot path. Each one has a scalar version and, on
+// x86, SSE and AVX versions. The best one supported by the CPU is picked once
+// at load time.
+
+// out[i] += in[i]
+void mixAdd(Sample *out, Sample const *in, int frames);
+
+// out[i] += in[i] * gain
+void mixScaled(Sample *out, Sample const *in, Sample gain, int frames);
+
+// out[i] += in0[i] * gain0 + in1[i] * gain1
+void mixPair(Sample *out, Sample const *in0, Sample gain0,
+        Sample const *in1, Sample gain1, int frames);
+
+// oscillator kernels. phases are in radians, in [-pi, pi). out and phases
+// may point to the same buffer.
+
+// phases[i] = start + i*w, wrapped. returns the phase following the block.
+Sample oscPhase(Sample *phases, Sample start, Sample w, int frames);
+
+// out[i] = gain * sin(phases[i])
+void oscSin(Sample *out, Sample const *phases, Sample gain, int frames);
+
+// out[i] = gain * phases[i] / pi
+void oscSaw(Sample *out, Sample const *phases, Sample gain, int frames);
+
+// out[i] = gain if edge < phases[i], -gain otherwise
+void oscPulse(Sample *out, Sample const *phases, Sample edge, Sample gain, int frames);
+
+// triangle reaching gain at pi*width and -gain at -pi*width
+void oscTri(Sample *out, Sample const *phases, Sample width, Sample gain, int frames);
+
+// out[i] += sum of gains[n] * sin(phase of oscillator n), for count sine
+// oscillators advancing by w[n] per sample. phases are updated in place.
+// scratch must hold 8*frames samples.
+void oscBank(Sample *out, Sample *scratch, Sample *phases,
+        Sample const *w, Sample const *gains, int count, int frames);
+
+// planar blocks, channel c starting at c*stride, to and from interleaved
+// frames of the given number of channels
+void interleave(Sample *out, Sample const *in, int channels, int stride, int frames);
+void deinterleave(Sample *out, Sample const *in, int channels, int stride, int frames);
+
+// wrap a single phase to [-pi, pi)
+Sample wrapPhase(Sample phase);
+
+// name of the instruction set in use: "avx", "sse" or "scalar"
+const char *simdName();
+
+#endif
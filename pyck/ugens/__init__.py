@@ -1,5 +1,10 @@
-import osc, env
+import osc, oscbank, wavetable, voicepool, arpeggio, delay, env
 
 from osc import *
+from oscbank import *
+from wavetable import *
+from voicepool import *
+from arpeggio import *
+from delay import *
 from env import *
 
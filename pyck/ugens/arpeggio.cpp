@@ -0,0 +1,89 @@
+#include "arpeggio.hpp"
+
+#include <boost/asio/yield.hpp>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// class Arpeggio
+
+Arpeggio::Arpeggio(OscPtr osc, object freqs, Duration step)
+{
+    this->osc = osc;
+    this->step = step;
+    this->note = 0;
+    setFreqs(freqs);
+}
+
+Arpeggio::~Arpeggio()
+{}
+
+boost::python::list Arpeggio::getFreqs()
+{
+    boost::python::list l;
+    for (size_t i=0; i<freqs.size(); i++) {
+        l.append(freqs[i]);
+    }
+    return l;
+}
+
+void Arpeggio::setFreqs(object freqs)
+{
+    // shreds run with the GIL held, so the sequence can change between two
+    // notes without further locking
+    vector<float> f;
+    for (int i=0; i<len(freqs); i++) {
+        f.push_back(extract<float>(freqs[i]));
+    }
+    this->freqs.swap(f);
+}
+
+Duration Arpeggio::getStep()
+{
+    return step;
+}
+
+void Arpeggio::setStep(Duration step)
+{
+    this->step = step;
+}
+
+EventPtr Arpeggio::getSync()
+{
+    return sync;
+}
+
+void Arpeggio::setSync(EventPtr sync)
+{
+    this->sync = sync;
+}
+
+void Arpeggio::resume()
+{
+    reenter (this) {
+        while (!freqs.empty()) {
+            if (sync) {
+                yield wait(sync);
+            }
+            for (note=0; note<freqs.size(); note++) {
+                osc->setFreq(freqs[note]);
+                yield sleep(step);
+            }
+        }
+    }
+}
+
+#include <boost/asio/unyield.hpp>
+
+///////////////////////////////////////////////////////////////////////////////
+// boost export
+
+BOOST_PYTHON_MODULE (libarpeggio)
+{
+    class_<Arpeggio, bases<NativeShred>, ArpeggioPtr, boost::noncopyable>("Arpeggio", init<OscPtr, object, Duration>())
+        .add_property("freqs", &Arpeggio::getFreqs, &Arpeggio::setFreqs)
+        .add_property("step", &Arpeggio::getStep, &Arpeggio::setStep)
+        .add_property("sync", &Arpeggio::getSync, &Arpeggio::setSync);
+}
@@ -0,0 +1,43 @@
+#ifndef ARPEGGIO_HPP
+#define ARPEGGIO_HPP
+
+#include "../core.hpp"
+#include "osc.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+// structs
+struct Arpeggio;
+
+// shared pointers
+typedef boost::shared_ptr<Arpeggio> ArpeggioPtr;
+
+// plays a sequence of frequencies on an oscillator, one every step samples.
+// when sync is set, every round of the sequence waits for it first.
+struct Arpeggio : NativeShred
+{
+    OscPtr osc;
+    std::vector<float> freqs;
+    Duration step;
+    EventPtr sync;
+
+    size_t note; // position in the sequence, kept across yields
+
+    Arpeggio(OscPtr osc, boost::python::object freqs, Duration step);
+    ~Arpeggio();
+
+    boost::python::list getFreqs();
+    void setFreqs(boost::python::object freqs);
+
+    Duration getStep();
+    void setStep(Duration step);
+
+    EventPtr getSync();
+    void setSync(EventPtr sync);
+
+    void resume();
+};
+
+#endif
@@ -0,0 +1 @@
+from libarpeggio import *
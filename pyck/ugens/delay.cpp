@@ -0,0 +1,132 @@
+#include "delay.hpp"
+
+#include <algorithm>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// class Delay
+
+Delay::Delay(int channels, int size) : UGen::UGen(channels, channels)
+{
+    // a shorter delay would need input that is not mixed yet
+    if (size < blockSize) {
+        PyErr_SetString(PyExc_ValueError, "a delay lasts at least a block");
+        throw_error_already_set();
+    }
+
+    this->feedback = true;
+    this->size = size;
+    this->length = size;
+    size_t samples = Arena::product(channels, size);
+    this->ring = Arena::samples(samples);
+    fill_n(ring.get(), samples, (Sample) 0);
+    this->base = 0;
+    this->end = 0;
+    this->silence = this->size;
+}
+
+Delay::~Delay()
+{}
+
+void Delay::allocate(int blockSize)
+{
+    UGen::allocate(blockSize);
+    if (size < blockSize) {
+        size_t samples = Arena::product(inputSize, blockSize);
+        ring = Arena::samples(samples);
+        fill_n(ring.get(), samples, (Sample) 0);
+        size = blockSize;
+        silence = size;
+    }
+    length = max(length, blockSize);
+}
+
+int Delay::getSize()
+{
+    return size;
+}
+
+int Delay::getLength()
+{
+    return length;
+}
+
+void Delay::setLength(int length)
+{
+    // less than a block would need input that is not mixed yet
+    if (blockSize <= length && length <= size) {
+        Server::post(new SetCommand<int>(shared_from_this(), &this->length, length));
+    }
+}
+
+void Delay::advance(int offset)
+{
+    // a new block has started
+    if (offset < end) {
+        base = (base + end) % size;
+        end = 0;
+    }
+}
+
+void Delay::process(int offset, int frames)
+{
+    advance(offset);
+
+    // the frames read were all stored during previous ranges
+    int read = (base + offset + size - length) % size;
+    int n = min(frames, size - read);
+    for (int c=0; c<outputSize; c++) {
+        Sample const *r = &ring[c*size];
+        Sample *out = &output[c*blockSize + offset];
+        copy(r + read, r + read + n, out);
+        copy(r, r + frames - n, out + n);
+    }
+}
+
+void Delay::store(int offset, int frames, bool silentInput)
+{
+    advance(offset);
+
+    int write = (base + offset) % size;
+    int n = min(frames, size - write);
+    if (!silentInput) {
+        for (int c=0; c<inputSize; c++) {
+            Sample const *in = &input[c*blockSize + offset];
+            Sample *r = &ring[c*size];
+            copy(in, in + n, r + write);
+            copy(in + n, in + frames, r);
+        }
+        silence = 0;
+    } else if (silence < size) {
+        // once the whole ring is silent, there is nothing left to clear
+        for (int c=0; c<inputSize; c++) {
+            Sample *r = &ring[c*size];
+            fill_n(r + write, n, (Sample) 0);
+            fill_n(r, frames - n, (Sample) 0);
+        }
+        silence = min(silence + frames, size);
+    }
+    end = offset + frames;
+}
+
+bool Delay::quiet(bool silentInput)
+{
+    // the input of a delay is mixed after it ran, so silentInput always
+    // holds here. store() counts the silent input instead: the delay sleeps
+    // once the frames to read are silent.
+    return length <= silence;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// boost export
+
+BOOST_PYTHON_MODULE (libdelay)
+{
+    class_<Delay, bases<UGen>, DelayPtr>("Delay", init<int, int>())
+        .add_property("size", &Delay::getSize)
+        .add_property("length", &Delay::getLength, &Delay::setLength);
+}
@@ -0,0 +1,47 @@
+#ifndef DELAY_HPP
+#define DELAY_HPP
+
+#include "../core.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
+
+// structs
+struct Delay;
+
+// shared pointers
+typedef boost::shared_ptr<Delay> DelayPtr;
+
+// delays its input by length samples, through a ring buffer holding size
+// samples per channel. the length is at least a block, so a delay can close
+// a feedback loop: echoes, combs or karplus-strong strings. a size shorter
+// than a block is rejected, and a delay made before the server grows to the
+// block size of the server if needed.
+struct Delay : UGen
+{
+    int size;
+    int length;
+
+    boost::shared_array<Sample> ring; // planar, channel c starts at c*size
+    int base; // ring position of the first frame of the current block
+    int end; // end of the frames stored in the current block
+    int silence; // number of silent frames stored lately
+
+    Delay(int channels, int size);
+    ~Delay();
+
+    void allocate(int blockSize);
+
+    int getSize();
+
+    int getLength();
+    void setLength(int length);
+
+    void advance(int offset);
+
+    void process(int offset, int frames);
+    void store(int offset, int frames, bool silentInput);
+    bool quiet(bool silentInput);
+};
+
+#endif
@@ -0,0 +1 @@
+from libdelay import *
@@ -18,16 +18,26 @@ Osc::Osc() : UGen::UGen(0,1)
 Osc::~Osc()
 {}
 
-float Osc::getFreq()
+// the values accepted for the parameters, ramp targets included
+static bool validFreq(float freq)
 {
-    return freq;
+    return 0 < freq;
+}
+
+static bool validGain(float gain)
+{
+    return 0 <= gain;
+}
+
+ParamRef Osc::getFreq()
+{
+    return ParamRef(shared_from_this(), &freq, &validFreq);
 }
 
 void Osc::setFreq(float freq)
 {
-    if (0 < freq) {
-        this->freq = freq;
-        this->init();
+    if (validFreq(freq)) {
+        Server::post(new SetCommand<Param>(shared_from_this(), &this->freq, freq));
     }
 }
 
@@ -39,21 +49,19 @@ float Osc::getPhase()
 void Osc::setPhase(float phase)
 {
     if (-M_PI < phase && phase <= M_PI) {
-        this->phase = phase;
-        this->init();
+        Server::post(new SetCommand<float>(shared_from_this(), &this->phase, phase));
     }
 }
 
-float Osc::getGain()
+ParamRef Osc::getGain()
 {
-    return gain;
+    return ParamRef(shared_from_this(), &gain, &validGain);
 }
 
 void Osc::setGain(float gain)
 {
-    if (0 <= gain) {
-        this->gain = gain;
-        this->init();
+    if (validGain(gain)) {
+        Server::post(new SetCommand<Param>(shared_from_this(), &this->gain, gain));
     }
 }
 
@@ -62,42 +70,51 @@ void Osc::init()
     w = freq * 2 * M_PI / Server::singleton->srate;
 }
 
-void Osc::compute()
+void Osc::process(int offset, int frames)
 {
-    phase += w;
-    if (M_PI < phase) {
-        phase -= 2 * M_PI;
+    if (!freq.moving() && !gain.moving()) {
+        render(offset, frames);
+        return;
+    }
+
+    int end = offset + frames;
+    while (offset < end) {
+        int n = std::min(Param::controlPeriod, end - offset);
+        render(offset, n);
+        freq.advance(n);
+        gain.advance(n);
+        init();
+        offset += n;
     }
 }
 
+void Osc::render(int offset, int frames)
+{
+    phase = wrapPhase(phase + frames * w);
+}
+
+bool Osc::quiet(bool silentInput)
+{
+    // an osc has no input, so silentInput always holds: only the gain
+    // matters. the phase stands still while asleep.
+    return !freq.moving() && !gain.moving() && gain == 0;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // class Sin
 
 Sin::Sin() : Osc::Osc()
-{
-    this->init();
-}
+{}
 
 Sin::~Sin()
 {}
 
-void Sin::init()
-{
-    Osc::init();
-    p = 2 * cos(w);
-    y[0] = sin(-2 * w + phase);
-    y[1] = sin(-1 * w + phase);
-    y[2] = 0;
-}
-
-void Sin::compute()
+void Sin::render(int offset, int frames)
 {
-    y[2] = p * y[1] - y[0];
-    y[0] = y[1];
-    y[1] = y[2];
-    output[0] = y[2] * gain;
-    Osc::compute();
+    Sample *out = &output[offset];
+    phase = oscPhase(out, phase, w, frames);
+    oscSin(out, out, gain, frames);
 }
 
 
@@ -110,15 +127,11 @@ Square::Square() : Osc::Osc()
 Square::~Square()
 {}
 
-void Square::compute()
+void Square::render(int offset, int frames)
 {
-    if (0 < phase) {
-        output[0] = gain;
-    } else {
-        output[0] = -gain;
-    }
-
-    Osc::compute();
+    Sample *out = &output[offset];
+    phase = oscPhase(out, phase, w, frames);
+    oscPulse(out, out, 0, gain, frames);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -130,10 +143,11 @@ Saw::Saw() : Osc::Osc()
 Saw::~Saw()
 {}
 
-void Saw::compute()
+void Saw::render(int offset, int frames)
 {
-    output[0] = phase/M_PI * gain;
-    Osc::compute();
+    Sample *out = &output[offset];
+    phase = oscPhase(out, phase, w, frames);
+    oscSaw(out, out, gain, frames);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -147,14 +161,11 @@ Pulse::Pulse() : Osc::Osc()
 Pulse::~Pulse()
 {}
 
-void Pulse::compute()
+void Pulse::render(int offset, int frames)
 {
-    if(M_PI*(width-0.5) < phase){
-        output[0] = gain;
-    } else {
-        output[0] = -gain;
-    }
-    Osc::compute();
+    Sample *out = &output[offset];
+    phase = oscPhase(out, phase, w, frames);
+    oscPulse(out, out, M_PI*(width-0.5), gain, frames);
 }
 
 float Pulse::getWidth()
@@ -165,7 +176,7 @@ float Pulse::getWidth()
 void Pulse::setWidth(float width)
 {
     if (0 <= width && width <= 1) {
-        this->width = width;
+        Server::post(new SetCommand<float>(shared_from_this(), &this->width, width));
     }
 }
 
@@ -180,27 +191,11 @@ Tri::Tri() : Osc::Osc()
 Tri::~Tri()
 {}
 
-void Tri::compute()
-{
-    float pw = M_PI * width;
-
-    if (phase < -pw) {
-        output[0] = (-M_PI - phase) / (M_PI - pw);
-    } else if (phase == -pw) {
-        output[0] = -1;
-    } else if (phase < 0) {
-        output[0] = phase / pw;
-    } else if (phase == 0) {
-        output[0] = 0;
-    } else if (phase < pw) {
-        output[0] = phase / pw;
-    } else if (phase == pw) {
-        output[0] = 1;
-    } else if (pw < phase) {
-        output[0] = (M_PI - phase) / (M_PI - pw);
-    }
-
-    Osc::compute();
+void Tri::render(int offset, int frames)
+{
+    Sample *out = &output[offset];
+    phase = oscPhase(out, phase, w, frames);
+    oscTri(out, out, width, gain, frames);
 }
 
 float Tri::getWidth()
@@ -211,7 +206,7 @@ float Tri::getWidth()
 void Tri::setWidth(float width)
 {
     if (0 <= width && width <= 1) {
-        this->width = width;
+        Server::post(new SetCommand<float>(shared_from_this(), &this->width, width));
     }
 }
 
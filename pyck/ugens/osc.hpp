@@ -2,10 +2,12 @@
 #define OSC_HPP
 
 #include "../core.hpp"
+#include "../simd.hpp"
 
 #include <boost/shared_ptr.hpp>
 
 #include <cmath>
+#include <algorithm>
 
 // structs
 struct Osc;
@@ -25,39 +27,41 @@ typedef boost::shared_ptr<Tri> TriPtr;
 
 struct Osc : UGen
 {
-    float freq;
+    Param freq;
     float phase;
-    float gain;
+    Param gain;
 
     float w; // angular speed in radians/sample
 
     Osc();
     ~Osc();
 
-    float getFreq();
+    ParamRef getFreq();
     void setFreq(float freq);
 
     float getPhase();
     void setPhase(float phase);
 
-    float getGain();
+    ParamRef getGain();
     void setGain(float gain);
 
     // (re)initialize internal values whenever a parameter is changed.
     virtual void init();
-    virtual void compute();
+
+    // render() produces the waveform with fixed parameters. process() calls
+    // it once per control period while a parameter is moving.
+    void process(int offset, int frames);
+    virtual void render(int offset, int frames);
+
+    bool quiet(bool silentInput);
 };
 
 struct Sin : Osc
 {
-    float y[3]; // previous values
-    float p; // iteration constant
-
     Sin();
     ~Sin();
 
-    virtual void init();
-    virtual void compute();    
+    void render(int offset, int frames);
 };
 
 struct Square : Osc
@@ -66,7 +70,7 @@ struct Square : Osc
     Square();
     ~Square();
 
-    void compute();
+    void render(int offset, int frames);
 };
 
 struct Saw : Osc
@@ -74,7 +78,7 @@ struct Saw : Osc
     Saw();
     ~Saw();
 
-    void compute();
+    void render(int offset, int frames);
 };
 
 struct Pulse : Osc
@@ -84,7 +88,7 @@ struct Pulse : Osc
     Pulse();
     ~Pulse();
 
-    void compute();
+    void render(int offset, int frames);
 
     float getWidth();
     void setWidth(float width);
@@ -97,7 +101,7 @@ struct Tri : Osc
     Tri();
     ~Tri();
 
-    void compute();
+    void render(int offset, int frames);
 
     float getWidth();
     void setWidth(float width);
@@ -0,0 +1,301 @@
+#include "oscbank.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+// copy a python sequence, or any buffer of samples, into an array of size
+// samples. returns the number of samples copied.
+static int readValues(object values, Sample *dest, int size)
+{
+    Py_buffer view;
+    if (PyObject_CheckBuffer(values.ptr()) &&
+            PyObject_GetBuffer(values.ptr(), &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0) {
+        const char *format = sizeof(Sample) == sizeof(float) ? "f" : "d";
+        bool samples = view.format && string(view.format) == format;
+        int n = 0;
+        if (samples) {
+            n = min(size, (int) (view.len / sizeof(Sample)));
+            memcpy(dest, view.buf, n * sizeof(Sample));
+        }
+        PyBuffer_Release(&view);
+        if (samples) {
+            return n;
+        }
+    } else {
+        // not a buffer after all: read it as a sequence
+        PyErr_Clear();
+    }
+
+    int n = min(size, (int) len(values));
+    for (int i=0; i<n; i++) {
+        dest[i] = extract<float>(values[i]);
+    }
+    return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class OscBank
+
+OscBank::OscBank(int size) : UGen::UGen(0,1)
+{
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "a bank holds at least one oscillator");
+        throw_error_already_set();
+    }
+    this->size = size;
+
+    freq = Arena::samples(size);
+    phase = Arena::samples(size);
+    gain = Arena::samples(size);
+    w = Arena::samples(size);
+    scratch = Arena::samples(8 * blockSize);
+
+    for (int i=0; i<size; i++) {
+        freq[i] = 440.0;
+        phase[i] = 0.0;
+        gain[i] = 0.0;
+    }
+    this->init();
+}
+
+OscBank::~OscBank()
+{}
+
+int OscBank::getSize()
+{
+    return size;
+}
+
+void OscBank::allocate(int blockSize)
+{
+    UGen::allocate(blockSize);
+    scratch = Arena::samples(8 * blockSize);
+}
+
+// change a single oscillator from the audio thread. the array is looked up
+// when the command is applied: setFreqs() and the like may have replaced it
+// in the meantime.
+struct OscBankCommand : Command
+{
+    OscBankPtr bank;
+    shared_array<Sample> OscBank::*values; // one of the parameter arrays of the bank
+    int index;
+    Sample value;
+
+    OscBankCommand(OscBankPtr bank, shared_array<Sample> OscBank::*values, int index, Sample value)
+        : bank(bank), values(values), index(index), value(value)
+    {}
+
+    void apply()
+    {
+        ((*bank).*values)[index] = value;
+        bank->update(index);
+    }
+
+    UGen *target()
+    {
+        return bank.get();
+    }
+};
+
+// new values for the first count oscillators, written over the current
+// array on the audio thread
+struct OscBankValuesCommand : Command
+{
+    OscBankPtr bank;
+    shared_array<Sample> OscBank::*values;
+    shared_array<Sample> update;
+    int count;
+
+    OscBankValuesCommand(OscBankPtr bank, shared_array<Sample> OscBank::*values,
+            shared_array<Sample> update, int count)
+        : bank(bank), values(values), update(update), count(count)
+    {}
+
+    void apply()
+    {
+        copy(update.get(), update.get() + count, ((*bank).*values).get());
+        for (int i=0; i<count; i++) {
+            bank->update(i);
+        }
+    }
+
+    UGen *target()
+    {
+        return bank.get();
+    }
+};
+
+void OscBank::post(shared_array<Sample> OscBank::*values, int index, Sample value)
+{
+    OscBankPtr self = static_pointer_cast<OscBank>(shared_from_this());
+    Server::post(new OscBankCommand(self, values, index, value));
+}
+
+void OscBank::post(shared_array<Sample> OscBank::*values, shared_array<Sample> update, int count)
+{
+    OscBankPtr self = static_pointer_cast<OscBank>(shared_from_this());
+    Server::post(new OscBankValuesCommand(self, values, update, count));
+}
+
+void OscBank::check(int i)
+{
+    if (!(0 <= i && i < size)) {
+        PyErr_SetString(PyExc_IndexError, "no such oscillator");
+        throw_error_already_set();
+    }
+}
+
+float OscBank::getFreq(int i)
+{
+    check(i);
+    return freq[i];
+}
+
+// the phases only wrap upwards, and a frequency beyond nyquist aliases
+static bool validFreq(Sample freq)
+{
+    return 0 < freq && freq < Server::singleton->srate / 2.0;
+}
+
+void OscBank::setFreq(int i, float freq)
+{
+    check(i);
+    if (validFreq(freq)) {
+        post(&OscBank::freq, i, freq);
+    }
+}
+
+void OscBank::setFreqs(object values)
+{
+    shared_array<Sample> freq = Arena::samples(size);
+    int count = readValues(values, freq.get(), size);
+    for (int i=0; i<count; i++) {
+        if (!validFreq(freq[i])) {
+            PyErr_SetString(PyExc_ValueError, "frequencies must be between 0 and half the sample rate");
+            throw_error_already_set();
+        }
+    }
+    post(&OscBank::freq, freq, count);
+}
+
+float OscBank::getPhase(int i)
+{
+    check(i);
+    return phase[i];
+}
+
+static bool validPhase(Sample phase)
+{
+    return -M_PI < phase && phase <= M_PI;
+}
+
+void OscBank::setPhase(int i, float phase)
+{
+    check(i);
+    if (validPhase(phase)) {
+        post(&OscBank::phase, i, wrapPhase(phase));
+    }
+}
+
+void OscBank::setPhases(object values)
+{
+    shared_array<Sample> phase = Arena::samples(size);
+    int count = readValues(values, phase.get(), size);
+    for (int i=0; i<count; i++) {
+        if (!validPhase(phase[i])) {
+            PyErr_SetString(PyExc_ValueError, "phases must be between -pi and pi");
+            throw_error_already_set();
+        }
+        phase[i] = wrapPhase(phase[i]);
+    }
+    post(&OscBank::phase, phase, count);
+}
+
+float OscBank::getGain(int i)
+{
+    check(i);
+    return gain[i];
+}
+
+static bool validGain(Sample gain)
+{
+    return 0 <= gain;
+}
+
+void OscBank::setGain(int i, float gain)
+{
+    check(i);
+    if (validGain(gain)) {
+        post(&OscBank::gain, i, gain);
+    }
+}
+
+void OscBank::setGains(object values)
+{
+    shared_array<Sample> gain = Arena::samples(size);
+    int count = readValues(values, gain.get(), size);
+    for (int i=0; i<count; i++) {
+        if (!validGain(gain[i])) {
+            PyErr_SetString(PyExc_ValueError, "gains must be positive");
+            throw_error_already_set();
+        }
+    }
+    post(&OscBank::gain, gain, count);
+}
+
+void OscBank::init()
+{
+    for (int i=0; i<size; i++) {
+        update(i);
+    }
+}
+
+void OscBank::update(int i)
+{
+    w[i] = freq[i] * 2 * M_PI / Server::singleton->srate;
+}
+
+void OscBank::process(int offset, int frames)
+{
+    Sample *out = &output[offset];
+    for (int k=0; k<frames; k++) {
+        out[k] = 0;
+    }
+    oscBank(out, scratch.get(), phase.get(), w.get(), gain.get(), size, frames);
+}
+
+bool OscBank::quiet(bool silentInput)
+{
+    // no input: silent once every gain is 0. the phases stand still while
+    // asleep.
+    for (int i=0; i<size; i++) {
+        if (gain[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// boost export
+
+BOOST_PYTHON_MODULE (liboscbank)
+{
+    class_<OscBank, bases<UGen>, OscBankPtr>("OscBank", init<int>())
+        .add_property("size", &OscBank::getSize)
+        .def("freq", &OscBank::getFreq)
+        .def("setFreq", &OscBank::setFreq)
+        .def("setFreqs", &OscBank::setFreqs)
+        .def("phase", &OscBank::getPhase)
+        .def("setPhase", &OscBank::setPhase)
+        .def("setPhases", &OscBank::setPhases)
+        .def("gain", &OscBank::getGain)
+        .def("setGain", &OscBank::setGain)
+        .def("setGains", &OscBank::setGains);
+}
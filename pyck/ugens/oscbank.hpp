@@ -0,0 +1,62 @@
+#ifndef OSCBANK_HPP
+#define OSCBANK_HPP
+
+#include "../core.hpp"
+#include "../simd.hpp"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
+
+#include <cmath>
+
+// structs
+struct OscBank;
+
+// shared pointers
+typedef boost::shared_ptr<OscBank> OscBankPtr;
+
+// a bank of sine oscillators summed to a single output. parameters are
+// stored as arrays so the whole bank is computed in one vectorized loop.
+struct OscBank : UGen
+{
+    int size;
+
+    boost::shared_array<Sample> freq;
+    boost::shared_array<Sample> phase;
+    boost::shared_array<Sample> gain;
+    boost::shared_array<Sample> w; // angular speeds in radians/sample
+
+    boost::shared_array<Sample> scratch; // partial sums, 8 per frame
+
+    OscBank(int size);
+    ~OscBank();
+
+    int getSize();
+
+    void allocate(int blockSize);
+
+    // raises IndexError for an oscillator out of the bank
+    void check(int i);
+
+    void post(boost::shared_array<Sample> OscBank::*values, int index, Sample value);
+    void post(boost::shared_array<Sample> OscBank::*values, boost::shared_array<Sample> update, int count);
+
+    float getFreq(int i);
+    void setFreq(int i, float freq);
+    void setFreqs(boost::python::object values);
+
+    float getPhase(int i);
+    void setPhase(int i, float phase);
+    void setPhases(boost::python::object values);
+
+    float getGain(int i);
+    void setGain(int i, float gain);
+    void setGains(boost::python::object values);
+
+    void init();
+    void update(int i);
+    void process(int offset, int frames);
+    bool quiet(bool silentInput);
+};
+
+#endif
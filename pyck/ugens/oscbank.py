@@ -0,0 +1 @@
+from liboscbank import *
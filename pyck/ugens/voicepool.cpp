@@ -0,0 +1,328 @@
+#include "voicepool.hpp"
+
+#include <algorithm>
+#include <map>
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// class VoicePool
+
+VoicePool::VoicePool(object factory, int count) : UGen::UGen(0,1)
+{
+    stealing = OLDEST;
+    attack = 64;
+    release = 64;
+    for (int s=0; s<3; s++) {
+        first[s] = -1;
+        last[s] = -1;
+    }
+
+    // the factory returns the output of a voice, or a sequence starting
+    // with it and holding the rest of the voice. the first Osc found there
+    // is tuned to the notes.
+    voices.resize(count);
+    for (int v=0; v<count; v++) {
+        Voice& voice = voices[v];
+        voice.handle = factory();
+
+        object items = voice.handle;
+        if (extract<UGenPtr>(items).check()) {
+            items = boost::python::make_tuple(items);
+        }
+        for (int i=0; i<len(items); i++) {
+            // None converts to an empty pointer
+            extract<UGenPtr> get(items[i]);
+            if (!get.check() || !get()) {
+                continue;
+            }
+            // BUGFIX boost::python doing nasty things with shared_ptr
+            UGenPtr ugen = get()->shared_from_this();
+            voice.parts.push_back(ugen);
+            if (!voice.output) {
+                voice.output = ugen;
+            }
+            if (!voice.osc && dynamic_cast<Osc*>(ugen.get())) {
+                voice.osc = static_pointer_cast<Osc>(ugen);
+            }
+        }
+
+        // process() reads every channel of every voice
+        if (!voice.output) {
+            PyErr_SetString(PyExc_ValueError, "the voice factory must return a ugen");
+            throw_error_already_set();
+        }
+        if (voice.output->outputSize != voices[0].output->outputSize) {
+            PyErr_SetString(PyExc_ValueError, "all the voices must have as many channels");
+            throw_error_already_set();
+        }
+
+        voice.gain = 0;
+        voice.since = 0;
+        voice.serial = 0;
+        append(Voice::IDLE, v);
+    }
+
+    // as many channels as a voice. voices are sources of the pool so that
+    // they are scheduled before it, but through silent routes: the pool
+    // mixes them itself with their own gain.
+    if (count) {
+        outputSize = voices[0].output->outputSize;
+        allocate(blockSize);
+    }
+    for (int v=0; v<count; v++) {
+        addSourceRoute(voices[v].output, RoutePtr(new Route(voices[v].output->outputSize, 0)));
+    }
+
+    // idle voices cost nothing: their ugens sleep until a note comes. a ugen
+    // shared by several voices, or gated elsewhere, keeps running.
+    map<UGen*, int> owner;
+    for (int v=0; v<count; v++) {
+        vector<UGenPtr>& parts = voices[v].parts;
+        for (size_t i=0; i<parts.size(); i++) {
+            UGen *ugen = parts[i].get();
+            bool shared = owner.count(ugen) && owner[ugen] != v;
+            owner[ugen] = ugen->gate || shared ? -1 : v;
+        }
+    }
+    for (map<UGen*, int>::iterator it = owner.begin(); it != owner.end(); ++it) {
+        if (it->second != -1) {
+            it->first->gate = this;
+            it->first->gateIndex = it->second;
+        }
+    }
+}
+
+VoicePool::~VoicePool()
+{
+    for (size_t v=0; v<voices.size(); v++) {
+        vector<UGenPtr>& parts = voices[v].parts;
+        for (size_t i=0; i<parts.size(); i++) {
+            if (parts[i]->gate == this) {
+                parts[i]->gate = NULL;
+            }
+        }
+    }
+}
+
+int VoicePool::getSize()
+{
+    return voices.size();
+}
+
+int VoicePool::getActive()
+{
+    int active = 0;
+    for (int v=first[Voice::HELD]; v!=-1; v=voices[v].next) {
+        active++;
+    }
+    return active;
+}
+
+object VoicePool::getVoice(int i)
+{
+    return voices.at(i).handle;
+}
+
+int VoicePool::getStealing()
+{
+    return stealing;
+}
+
+void VoicePool::setStealing(int stealing)
+{
+    this->stealing = stealing;
+}
+
+Duration VoicePool::getAttack()
+{
+    return attack;
+}
+
+void VoicePool::setAttack(Duration attack)
+{
+    this->attack = attack;
+}
+
+Duration VoicePool::getRelease()
+{
+    return release;
+}
+
+void VoicePool::setRelease(Duration release)
+{
+    this->release = release;
+}
+
+void VoicePool::unlink(int v)
+{
+    Voice& voice = voices[v];
+    if (voice.prev != -1) {
+        voices[voice.prev].next = voice.next;
+    } else {
+        first[voice.state] = voice.next;
+    }
+    if (voice.next != -1) {
+        voices[voice.next].prev = voice.prev;
+    } else {
+        last[voice.state] = voice.prev;
+    }
+}
+
+void VoicePool::append(int state, int v)
+{
+    Voice& voice = voices[v];
+    voice.state = state;
+    voice.prev = last[state];
+    voice.next = -1;
+    if (last[state] != -1) {
+        voices[last[state]].next = v;
+    } else {
+        first[state] = v;
+    }
+    last[state] = v;
+}
+
+int VoicePool::steal()
+{
+    // held voices are in order of arrival
+    if (stealing == OLDEST) {
+        return first[Voice::HELD];
+    }
+
+    // the gains are read while the audio thread moves them, which is fine
+    // for picking a victim
+    int quietest = first[Voice::HELD];
+    for (int v=first[Voice::HELD]; v!=-1; v=voices[v].next) {
+        if (voices[v].gain.value < voices[quietest].gain.value) {
+            quietest = v;
+        }
+    }
+    return quietest;
+}
+
+long VoicePool::noteOn(float freq, float velocity)
+{
+    if (voices.empty()) {
+        return -1;
+    }
+    Time now = Server::singleton->getNow();
+
+    // a voice done with its release, then a voice never used, then the
+    // voice released first, then a held voice
+    int v;
+    int released = first[Voice::RELEASED];
+    if (released != -1 && voices[released].since <= now) {
+        v = released;
+    } else if (first[Voice::IDLE] != -1) {
+        v = first[Voice::IDLE];
+    } else if (released != -1) {
+        v = released;
+    } else {
+        v = steal();
+    }
+
+    Voice& voice = voices[v];
+    unlink(v);
+    append(Voice::HELD, v);
+    voice.since = now;
+    voice.serial++;
+
+    if (voice.osc && 0 < freq) {
+        voice.osc->setFreq(freq);
+    }
+    Server::post(new RampCommand(shared_from_this(), &voice.gain, Param::LINEAR, velocity, attack));
+
+    // note ids tell apart successive notes on the same voice
+    return voice.serial * voices.size() + v;
+}
+
+void VoicePool::noteOff(long note)
+{
+    if (note < 0 || voices.empty()) {
+        return;
+    }
+    int v = note % voices.size();
+    Voice& voice = voices[v];
+    if (voice.state != Voice::HELD || voice.serial != note / (long) voices.size()) {
+        // already released, or stolen since
+        return;
+    }
+
+    unlink(v);
+    append(Voice::RELEASED, v);
+    voice.since = Server::singleton->getNow() + release;
+    Server::post(new RampCommand(shared_from_this(), &voice.gain, Param::LINEAR, 0, release));
+}
+
+void VoicePool::process(int offset, int frames)
+{
+    resetOutput(offset, frames);
+
+    for (size_t v=0; v<voices.size(); v++) {
+        Voice& voice = voices[v];
+        if (!voice.output || (!voice.gain.moving() && voice.gain.value == 0)) {
+            continue;
+        }
+        if (voice.output->silent) {
+            voice.gain.advance(frames);
+            continue;
+        }
+
+        // constant gain over a control period while the envelope moves
+        int end = offset + frames;
+        for (int start=offset; start<end; ) {
+            int n = voice.gain.moving() ? min(Param::controlPeriod, end - start) : end - start;
+            for (int c=0; c<outputSize; c++) {
+                mixScaled(&output[c*blockSize + start],
+                        &voice.output->output[c*voice.output->blockSize + start],
+                        voice.gain.value, n);
+            }
+            voice.gain.advance(n);
+            start += n;
+        }
+    }
+}
+
+bool VoicePool::gateOpen(int index)
+{
+    Voice& voice = voices[index];
+    return voice.gain.moving() || voice.gain.value != 0;
+}
+
+bool VoicePool::quiet(bool silentInput)
+{
+    // the voices are read directly, not through the input: their silence
+    // counts instead. a moving envelope keeps the pool awake to advance it.
+    for (size_t v=0; v<voices.size(); v++) {
+        Voice& voice = voices[v];
+        if (voice.gain.moving() || (voice.gain.value != 0 && !voice.output->silent)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// boost export
+
+BOOST_PYTHON_MODULE (libvoicepool)
+{
+    enum_<VoicePool::Stealing>("Stealing")
+        .value("OLDEST", VoicePool::OLDEST)
+        .value("QUIETEST", VoicePool::QUIETEST)
+        .export_values();
+
+    class_<VoicePool, bases<UGen>, VoicePoolPtr>("VoicePool", init<object, int>())
+        .add_property("size", &VoicePool::getSize)
+        .add_property("active", &VoicePool::getActive)
+        .add_property("stealing", &VoicePool::getStealing, &VoicePool::setStealing)
+        .add_property("attack", &VoicePool::getAttack, &VoicePool::setAttack)
+        .add_property("release", &VoicePool::getRelease, &VoicePool::setRelease)
+        .def("voice", &VoicePool::getVoice)
+        .def("noteOn", &VoicePool::noteOn, (boost::python::arg("freq"), boost::python::arg("velocity")=1.0))
+        .def("noteOff", &VoicePool::noteOff);
+}
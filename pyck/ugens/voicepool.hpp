@@ -0,0 +1,77 @@
+#ifndef VOICEPOOL_HPP
+#define VOICEPOOL_HPP
+
+#include "../core.hpp"
+#include "../simd.hpp"
+#include "osc.hpp"
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+// structs
+struct Voice;
+struct VoicePool;
+
+// shared pointers
+typedef boost::shared_ptr<VoicePool> VoicePoolPtr;
+
+struct Voice
+{
+    enum State {IDLE, HELD, RELEASED};
+
+    UGenPtr output;
+    OscPtr osc; // gets the note frequency, if any
+    boost::python::object handle; // what the factory returned
+    std::vector<UGenPtr> parts; // the ugens returned, gated by the pool
+
+    Param gain; // envelope, applied by the pool
+
+    // control side bookkeeping
+    int state;
+    Time since; // start of the note, or end of its release
+    long serial; // notes played, to recognize stale note ids
+    int prev, next; // in the list of voices in the same state
+};
+
+// a fixed set of voices built up front from a template, mixed to a single
+// output. notes grab an idle voice, or steal one, so starting a note never
+// allocates a ugen or changes the graph. the ugens returned for a voice
+// sleep while its envelope is at 0, unless other voices share them.
+struct VoicePool : UGen
+{
+    enum Stealing {OLDEST, QUIETEST};
+
+    std::vector<Voice> voices;
+    int first[3], last[3]; // voices by state, in order of arrival
+    int stealing;
+    Duration attack;
+    Duration release;
+
+    VoicePool(boost::python::object factory, int count);
+    ~VoicePool();
+
+    int getSize();
+    int getActive();
+    boost::python::object getVoice(int i);
+
+    int getStealing();
+    void setStealing(int stealing);
+    Duration getAttack();
+    void setAttack(Duration attack);
+    Duration getRelease();
+    void setRelease(Duration release);
+
+    void unlink(int v);
+    void append(int state, int v);
+    int steal();
+
+    long noteOn(float freq, float velocity);
+    void noteOff(long note);
+
+    void process(int offset, int frames);
+    bool quiet(bool silentInput);
+    bool gateOpen(int index);
+};
+
+#endif
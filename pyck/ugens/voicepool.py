@@ -0,0 +1 @@
+from libvoicepool import *
@@ -0,0 +1,213 @@
+#include "wavetable.hpp"
+
+using namespace boost;
+using namespace boost::python;
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+// class Table
+
+std::map< std::string, boost::weak_ptr<Table> > Table::registry;
+
+Table::Table()
+{
+    data = Arena::samples(levels * (size+1));
+}
+
+Table::Table(object values)
+{
+    // user data is one cycle of any length: analyse it with a plain DFT, it
+    // only runs once per table
+    int n = len(values);
+    if (n < 2) {
+        PyErr_SetString(PyExc_ValueError, "a table needs at least 2 values");
+        throw_error_already_set();
+    }
+    data = Arena::samples(levels * (size+1));
+
+    vector<double> x(n);
+    for (int i=0; i<n; i++) {
+        x[i] = extract<double>(values[i]);
+    }
+
+    int harmonics = min(n/2, (int) maxHarmonic);
+    vector<double> re(harmonics+1, 0.0);
+    vector<double> im(harmonics+1, 0.0);
+    for (int h=0; h<=harmonics; h++) {
+        for (int i=0; i<n; i++) {
+            double t = 2 * M_PI * h * i / n;
+            re[h] += x[i] * cos(t);
+            im[h] += x[i] * sin(t);
+        }
+        re[h] *= (h == 0 ? 1.0 : 2.0) / n;
+        im[h] *= 2.0 / n;
+    }
+    build(re, im);
+}
+
+Table::~Table()
+{}
+
+TablePtr Table::get(string name)
+{
+    TablePtr table = registry[name].lock();
+    if (table) {
+        return table;
+    }
+
+    vector<double> re(maxHarmonic+1, 0.0);
+    vector<double> im(maxHarmonic+1, 0.0);
+    for (int h=1; h<=maxHarmonic; h++) {
+        double odd = h % 2;
+        if (name == "sine") {
+            im[h] = (h == 1);
+        } else if (name == "saw") {
+            // same shape as Saw: a ramp from -1 to 1
+            im[h] = (h % 2 ? 2 : -2) / (M_PI * h);
+        } else if (name == "square") {
+            im[h] = odd * 4 / (M_PI * h);
+        } else if (name == "tri") {
+            // same shape as Tri with width 0.5
+            im[h] = odd * ((h/2) % 2 ? -8 : 8) / (M_PI * M_PI * h * h);
+        }
+    }
+
+    table = TablePtr(new Table());
+    table->build(re, im);
+    registry[name] = table;
+    return table;
+}
+
+TablePtr Table::sine()
+{
+    return get("sine");
+}
+
+TablePtr Table::saw()
+{
+    return get("saw");
+}
+
+TablePtr Table::square()
+{
+    return get("square");
+}
+
+TablePtr Table::tri()
+{
+    return get("tri");
+}
+
+void Table::build(vector<double> const& re, vector<double> const& im)
+{
+    // exact sin/cos of multiples of the table step
+    vector<double> sines(size);
+    vector<double> cosines(size);
+    for (int i=0; i<size; i++) {
+        sines[i] = sin(2 * M_PI * i / size);
+        cosines[i] = cos(2 * M_PI * i / size);
+    }
+
+    int harmonics = re.size() - 1;
+    for (int l=0; l<levels; l++) {
+        Sample *level = getLevel(l);
+        int top = min(harmonics, maxHarmonic >> l);
+        for (int i=0; i<size; i++) {
+            double x = re[0];
+            for (int h=1; h<=top; h++) {
+                int j = (h * i) % size;
+                x += re[h] * cosines[j] + im[h] * sines[j];
+            }
+            level[i] = x;
+        }
+        level[size] = level[0];
+    }
+}
+
+int Table::level(float w)
+{
+    // harmonic h sits at h*w radians/sample and must stay below pi
+    int l = 0;
+    while (l < levels-1 && (maxHarmonic >> l) * w >= M_PI) {
+        l++;
+    }
+    return l;
+}
+
+Sample *Table::getLevel(int level)
+{
+    return &data[level * (size+1)];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// class Wavetable
+
+Wavetable::Wavetable() : Osc::Osc()
+{
+    table = Table::sine();
+    this->init();
+}
+
+Wavetable::Wavetable(TablePtr table) : Osc::Osc()
+{
+    this->table = table;
+    this->init();
+}
+
+Wavetable::~Wavetable()
+{}
+
+TablePtr Wavetable::getTable()
+{
+    return table;
+}
+
+void Wavetable::setTable(TablePtr table)
+{
+    if (table) {
+        Server::post(new SetCommand<TablePtr>(shared_from_this(), &this->table, table));
+    }
+}
+
+void Wavetable::init()
+{
+    Osc::init();
+    level = Table::level(w);
+}
+
+void Wavetable::render(int offset, int frames)
+{
+    Sample *out = &output[offset];
+    Sample *data = table->getLevel(level);
+    float scale = Table::size / (2 * M_PI);
+
+    phase = oscPhase(out, phase, w, frames);
+    for (int i=0; i<frames; i++) {
+        // phases are in [-pi, pi), the table starts at 0
+        float x = out[i] * scale;
+        if (x < 0) {
+            x += Table::size;
+        }
+        int j = (int) x;
+        float frac = x - j;
+        j &= Table::size - 1;
+        out[i] = gain * (data[j] + frac * (data[j+1] - data[j]));
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// boost export
+
+BOOST_PYTHON_MODULE (libwavetable)
+{
+    class_<Table, TablePtr>("Table", init<object>())
+        .def("sine", &Table::sine).staticmethod("sine")
+        .def("saw", &Table::saw).staticmethod("saw")
+        .def("square", &Table::square).staticmethod("square")
+        .def("tri", &Table::tri).staticmethod("tri");
+
+    class_<Wavetable, bases<Osc>, WavetablePtr>("Wavetable")
+        .def(init<TablePtr>())
+        .add_property("table", &Wavetable::getTable, &Wavetable::setTable);
+}
@@ -0,0 +1,74 @@
+#ifndef WAVETABLE_HPP
+#define WAVETABLE_HPP
+
+#include "osc.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/shared_array.hpp>
+
+// structs
+struct Table;
+struct Wavetable;
+
+// shared pointers
+typedef boost::shared_ptr<Table> TablePtr;
+typedef boost::shared_ptr<Wavetable> WavetablePtr;
+
+// one cycle of a waveform, stored as a mipmap of band-limited copies: level l
+// only holds the harmonics up to maxHarmonic >> l. tables are immutable once
+// built, so any number of oscillators can share one.
+struct Table
+{
+    static const int size = 2048; // samples per level
+    static const int levels = 10;
+    static const int maxHarmonic = 512;
+
+    // shared tables for the basic waveforms, built on first use and freed
+    // when the last oscillator using them is gone
+    static std::map< std::string, boost::weak_ptr<Table> > registry;
+
+    // size+1 samples per level, the last one repeating the first so that
+    // interpolation never wraps
+    boost::shared_array<Sample> data;
+
+    Table();
+    Table(boost::python::object values);
+    ~Table();
+
+    static TablePtr get(std::string name);
+    static TablePtr sine();
+    static TablePtr saw();
+    static TablePtr square();
+    static TablePtr tri();
+
+    // build every level from the fourier series
+    // x(t) = re[0] + sum re[h]*cos(h*t) + im[h]*sin(h*t)
+    void build(std::vector<double> const& re, std::vector<double> const& im);
+
+    // the level to use for an oscillator advancing by w radians/sample
+    static int level(float w);
+    Sample *getLevel(int level);
+};
+
+struct Wavetable : Osc
+{
+    TablePtr table;
+    int level; // mipmap level matching the current frequency
+
+    Wavetable();
+    Wavetable(TablePtr table);
+    ~Wavetable();
+
+    TablePtr getTable();
+    void setTable(TablePtr table);
+
+    void init();
+    void render(int offset, int frames);
+};
+
+#endif
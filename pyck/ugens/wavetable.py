@@ -0,0 +1 @@
+from libwavetable import *